@@ -0,0 +1,68 @@
+#include "bloom_filter.h"
+#include <stdlib.h>
+
+#define BITS_IN_WORD 64
+#define MIN_BITS 1024
+#define LN_2_NUMERATOR 693
+#define LN_2_DENOMINATOR 1000
+#define HASH_HALF_BITS 32
+
+BloomFilter *create_bloom_filter (size_t num_of_items, int bits_per_item)
+{
+  BloomFilter *bloom_filter = malloc (sizeof (BloomFilter));
+  if (bloom_filter == NULL)
+  {
+    return NULL;
+  }
+  size_t num_of_bits = MIN_BITS;
+  while (num_of_bits < num_of_items * bits_per_item)
+  {
+    num_of_bits *= 2;
+  }
+  bloom_filter->num_of_bits = num_of_bits;
+  // The false positive rate is lowest with ln(2) probes per bit per item
+  bloom_filter->num_of_probes = bits_per_item * LN_2_NUMERATOR
+                                / LN_2_DENOMINATOR;
+  if (bloom_filter->num_of_probes < 1)
+  {
+    bloom_filter->num_of_probes = 1;
+  }
+  bloom_filter->bits = calloc (num_of_bits / BITS_IN_WORD, sizeof (uint64_t));
+  if (bloom_filter->bits == NULL)
+  {
+    free (bloom_filter);
+    return NULL;
+  }
+  return bloom_filter;
+}
+
+bool test_and_add_hash (BloomFilter *bloom_filter, uint64_t hash)
+{
+  // The probes are h1 + i * h2, for the two halves of the hash
+  uint64_t probe = hash & UINT32_MAX;
+  uint64_t step = (hash >> HASH_HALF_BITS) | 1;
+  bool present = true;
+  for (int i = 0; i < bloom_filter->num_of_probes; i++)
+  {
+    size_t bit = probe & (bloom_filter->num_of_bits - 1);
+    uint64_t mask = (uint64_t) 1 << (bit % BITS_IN_WORD);
+    if ((bloom_filter->bits[bit / BITS_IN_WORD] & mask) == 0)
+    {
+      present = false;
+      bloom_filter->bits[bit / BITS_IN_WORD] |= mask;
+    }
+    probe += step;
+  }
+  return present;
+}
+
+void free_bloom_filter (BloomFilter **ptr_bloom_filter)
+{
+  if (*ptr_bloom_filter == NULL)
+  {
+    return;
+  }
+  free ((*ptr_bloom_filter)->bits);
+  free (*ptr_bloom_filter);
+  *ptr_bloom_filter = NULL;
+}
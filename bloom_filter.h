@@ -0,0 +1,41 @@
+#ifndef _BLOOM_FILTER_H_
+#define _BLOOM_FILTER_H_
+#include <stdbool.h> // for bool
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+/**
+ * struct holds a Bloom filter: a set of hashes that may wrongly report a
+ * hash as present, but never misses one that was added
+ */
+typedef struct BloomFilter {
+    uint64_t *bits;
+    size_t num_of_bits; // a power of 2
+    int num_of_probes; // num of bits set per hash
+} BloomFilter;
+
+/**
+ * Create a new, empty Bloom filter.
+ * @param num_of_items num of hashes expected to be added
+ * @param bits_per_item memory per hash, in bits. The filter has at least
+ * num_of_items * bits_per_item bits.
+ * @return pointer to the new BloomFilter, NULL in case of allocation failure.
+ */
+BloomFilter *create_bloom_filter(size_t num_of_items, int bits_per_item);
+
+/**
+ * Check whether a hash was added to the filter, and add it.
+ * @param bloom_filter
+ * @param hash a well mixed 64 bit hash
+ * @return true if the hash may have been added before, false if it surely
+ * was not.
+ */
+bool test_and_add_hash(BloomFilter *bloom_filter, uint64_t hash);
+
+/**
+ * Free a Bloom filter.
+ * @param ptr_bloom_filter pointer to the filter to free, set to NULL
+ */
+void free_bloom_filter(BloomFilter **ptr_bloom_filter);
+
+#endif //_BLOOM_FILTER_H_
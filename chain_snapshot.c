@@ -0,0 +1,158 @@
+#define _ISOC11_SOURCE // For aligned_alloc()
+#include "chain_snapshot.h"
+#include <string.h> // For memset()
+
+#define FIRST_EPOCH 1
+#define NO_EPOCH 0
+
+/**
+ * This function frees a snapshot and its copy of the chain.
+ * @param snapshot
+ */
+static void free_snapshot (ChainSnapshot *snapshot)
+{
+  free_chain_replica (&snapshot->replica);
+  free (snapshot);
+}
+
+/**
+ * This function checks if a retired snapshot may be held by a reader: a
+ * reader that entered before the snapshot was replaced may have got it.
+ * @param publisher
+ * @param snapshot
+ * @return true if no reader may hold it, false otherwise.
+ */
+static bool is_snapshot_free (const SnapshotPublisher *publisher,
+                              const ChainSnapshot *snapshot)
+{
+  for (int i = 0; i < publisher->num_of_readers; i++)
+  {
+    unsigned long int epoch = __atomic_load_n (&publisher->readers[i].epoch,
+                                               __ATOMIC_SEQ_CST);
+    if ((epoch != NO_EPOCH) && (epoch < snapshot->retire_epoch))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * This function frees the retired snapshots no reader holds.
+ * @param publisher
+ */
+static void free_retired_snapshots (SnapshotPublisher *publisher)
+{
+  ChainSnapshot **link = &publisher->retired;
+  while (*link != NULL)
+  {
+    ChainSnapshot *snapshot = *link;
+    if (is_snapshot_free (publisher, snapshot))
+    {
+      *link = snapshot->next_retired;
+      free_snapshot (snapshot);
+      publisher->num_of_freed++;
+    }
+    else
+    {
+      link = &snapshot->next_retired;
+    }
+  }
+}
+
+SnapshotPublisher *create_snapshot_publisher (int num_of_readers)
+{
+  SnapshotPublisher *publisher = malloc (sizeof (SnapshotPublisher));
+  if (publisher == NULL)
+  {
+    return NULL;
+  }
+  // each slot on its own cache line, so readers don't share lines
+  size_t readers_bytes = num_of_readers * sizeof (ReaderEpoch);
+  readers_bytes = (readers_bytes + CACHE_LINE_SIZE - 1)
+                  / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+  publisher->readers = aligned_alloc (CACHE_LINE_SIZE, readers_bytes);
+  if (publisher->readers == NULL)
+  {
+    free (publisher);
+    return NULL;
+  }
+  memset (publisher->readers, 0, readers_bytes);
+  publisher->current = NULL;
+  publisher->epoch = FIRST_EPOCH;
+  publisher->num_of_readers = num_of_readers;
+  publisher->retired = NULL;
+  publisher->num_of_published = 0;
+  publisher->num_of_freed = 0;
+  return publisher;
+}
+
+bool publish_snapshot (SnapshotPublisher *publisher, MarkovChain *markov_chain,
+                       bool compress)
+{
+  ChainSnapshot *snapshot = malloc (sizeof (ChainSnapshot));
+  if (snapshot == NULL)
+  {
+    printf ("%s", ALLOCATION_ERROR_MASSAGE);
+    return false;
+  }
+  if (!create_chain_replica (markov_chain, NO_NUMA_NODE, compress, false,
+                             &snapshot->replica))
+  {
+    free (snapshot);
+    return false;
+  }
+  snapshot->version = publisher->num_of_published;
+  snapshot->next_retired = NULL;
+  ChainSnapshot *old = __atomic_exchange_n (&publisher->current, snapshot,
+                                            __ATOMIC_SEQ_CST);
+  // Readers that enter from now on get the new snapshot
+  unsigned long int epoch = __atomic_add_fetch (&publisher->epoch, 1,
+                                                __ATOMIC_SEQ_CST);
+  publisher->num_of_published++;
+  if (old != NULL)
+  {
+    old->retire_epoch = epoch;
+    old->next_retired = publisher->retired;
+    publisher->retired = old;
+  }
+  free_retired_snapshots (publisher);
+  return true;
+}
+
+const ChainSnapshot *enter_snapshot (SnapshotPublisher *publisher, int reader)
+{
+  unsigned long int epoch = __atomic_load_n (&publisher->epoch,
+                                             __ATOMIC_SEQ_CST);
+  __atomic_store_n (&publisher->readers[reader].epoch, epoch,
+                    __ATOMIC_SEQ_CST);
+  return __atomic_load_n (&publisher->current, __ATOMIC_SEQ_CST);
+}
+
+void leave_snapshot (SnapshotPublisher *publisher, int reader)
+{
+  __atomic_store_n (&publisher->readers[reader].epoch, NO_EPOCH,
+                    __ATOMIC_RELEASE);
+}
+
+void free_snapshot_publisher (SnapshotPublisher **ptr_publisher)
+{
+  SnapshotPublisher *publisher = *ptr_publisher;
+  if (publisher == NULL)
+  {
+    return;
+  }
+  while (publisher->retired != NULL)
+  {
+    ChainSnapshot *next = publisher->retired->next_retired;
+    free_snapshot (publisher->retired);
+    publisher->retired = next;
+  }
+  if (publisher->current != NULL)
+  {
+    free_snapshot (publisher->current);
+  }
+  free (publisher->readers);
+  free (publisher);
+  *ptr_publisher = NULL;
+}
@@ -0,0 +1,90 @@
+#ifndef _CHAIN_SNAPSHOT_H_
+#define _CHAIN_SNAPSHOT_H_
+#include "numa_replica.h"
+
+#define CACHE_LINE_SIZE 64
+
+/**
+ * struct holds a published, read-only version of a chain that is still
+ * being trained
+ */
+typedef struct ChainSnapshot {
+    ChainReplica replica; // the copy of the chain, and its states by order
+    long int version; // num of snapshots published before this one
+    unsigned long int retire_epoch; // epoch it was replaced in, if retired
+    struct ChainSnapshot *next_retired;
+} ChainSnapshot;
+
+/**
+ * struct holds the epoch a reader entered in, alone in its cache line
+ */
+typedef struct ReaderEpoch {
+    unsigned long int epoch; // 0 while the reader holds no snapshot
+    char padding[CACHE_LINE_SIZE - sizeof (unsigned long int)];
+} ReaderEpoch;
+
+/**
+ * struct holds the snapshots of a chain that one writer trains while many
+ * readers sample from it. The writer publishes a new snapshot by replacing
+ * a single pointer, so readers never wait for the writer or for each other.
+ * A replaced snapshot is retired, and freed once every reader that may hold
+ * it has left, as told by the epochs the readers entered in. Each snapshot
+ * is a full copy of the chain, made on the writer's thread, so a publication
+ * costs time and memory linear in the size of the chain: the interval
+ * between publications should grow with it.
+ */
+typedef struct SnapshotPublisher {
+    ChainSnapshot *current; // the latest snapshot, NULL before the first
+    unsigned long int epoch; // increased on each publication, from 1
+    ReaderEpoch *readers;
+    int num_of_readers;
+    ChainSnapshot *retired; // replaced snapshots not freed yet, writer only
+    long int num_of_published;
+    long int num_of_freed;
+} SnapshotPublisher;
+
+/**
+ * Create a publisher with no snapshot yet.
+ * @param num_of_readers num of reader threads, with ids 0 to num_of_readers-1,
+ * at least 1
+ * @return pointer to the new SnapshotPublisher, NULL in case of allocation
+ * failure.
+ */
+SnapshotPublisher *create_snapshot_publisher(int num_of_readers);
+
+/**
+ * Publish a snapshot of a chain, and free the retired snapshots no reader
+ * holds. Called by the writer only, between changes to the chain. Copies
+ * the whole chain, and compresses the copy if asked to, so it takes time
+ * linear in the num of states and transitions.
+ * @param publisher
+ * @param markov_chain the chain being trained, not modified
+ * @param compress whether to compress the snapshot
+ * @return true on success, false in case of allocation failure.
+ */
+bool publish_snapshot(SnapshotPublisher *publisher, MarkovChain *markov_chain,
+                      bool compress);
+
+/**
+ * Enter a reader and get the latest snapshot. It stays valid until the
+ * reader calls leave_snapshot. Lock-free.
+ * @param publisher
+ * @param reader id of the calling reader
+ * @return the snapshot, NULL if none was published yet.
+ */
+const ChainSnapshot *enter_snapshot(SnapshotPublisher *publisher, int reader);
+
+/**
+ * Leave a reader, releasing the snapshot it got. Lock-free.
+ * @param publisher
+ * @param reader id of the calling reader
+ */
+void leave_snapshot(SnapshotPublisher *publisher, int reader);
+
+/**
+ * Free a publisher and all of its snapshots. No reader may hold a snapshot.
+ * @param ptr_publisher pointer to the publisher to free, set to NULL
+ */
+void free_snapshot_publisher(SnapshotPublisher **ptr_publisher);
+
+#endif //_CHAIN_SNAPSHOT_H_
@@ -0,0 +1,261 @@
+#define _POSIX_C_SOURCE 200809L // For fdopen(), fileno(), pthread_sigmask()
+#include "input_stream.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define BLOCK_SIZE (64 * 1024)
+#define MAGIC_LEN 4
+#define GZIP_MAGIC "\x1f\x8b"
+#define GZIP_MAGIC_LEN 2
+#define ZSTD_MAGIC "\x28\xb5\x2f\xfd"
+#define ZSTD_MAGIC_LEN 4
+#define GZIP_WINDOW_BITS (MAX_WBITS + 16)
+
+/**
+ * This function writes a whole block to the pipe.
+ * @param fd the pipe
+ * @param block
+ * @param len num of bytes
+ * @return true on success, false if the reader closed the pipe.
+ */
+static bool write_block (int fd, const unsigned char *block, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t written = write (fd, block, len);
+    if (written < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      return false;
+    }
+    block += written;
+    len -= (size_t) written;
+  }
+  return true;
+}
+
+/**
+ * This function decompresses a gzip file, of one or more members, to the
+ * pipe.
+ * @param stream
+ * @return false if the data is invalid or cut, true otherwise.
+ */
+static bool decompress_gzip (InputStream *stream)
+{
+  unsigned char in[BLOCK_SIZE], out[BLOCK_SIZE];
+  z_stream inflater;
+  memset (&inflater, 0, sizeof (z_stream));
+  if (inflateInit2 (&inflater, GZIP_WINDOW_BITS) != Z_OK)
+  {
+    return false;
+  }
+  int status = Z_OK;
+  bool reading = true;
+  while (reading)
+  {
+    inflater.avail_in = fread (in, 1, BLOCK_SIZE, stream->raw_file);
+    inflater.next_in = in;
+    if (inflater.avail_in == 0)
+    {
+      break;
+    }
+    while (reading && (inflater.avail_in > 0))
+    {
+      if (status == Z_STREAM_END)
+      {
+        inflateReset (&inflater); // the next member of the file
+      }
+      inflater.next_out = out;
+      inflater.avail_out = BLOCK_SIZE;
+      status = inflate (&inflater, Z_NO_FLUSH);
+      if ((status != Z_OK) && (status != Z_STREAM_END)
+          && (status != Z_BUF_ERROR))
+      {
+        inflateEnd (&inflater);
+        return false;
+      }
+      reading = write_block (stream->pipe_fd, out,
+                             BLOCK_SIZE - inflater.avail_out);
+    }
+  }
+  inflateEnd (&inflater);
+  return !reading || (status == Z_STREAM_END);
+}
+
+#ifdef HAVE_ZSTD
+/**
+ * This function decompresses a zstd file, of one or more frames, to the
+ * pipe.
+ * @param stream
+ * @return false if the data is invalid or cut, true otherwise.
+ */
+static bool decompress_zstd (InputStream *stream)
+{
+  unsigned char in[BLOCK_SIZE], out[BLOCK_SIZE];
+  ZSTD_DStream *decompressor = ZSTD_createDStream ();
+  if (decompressor == NULL)
+  {
+    return false;
+  }
+  size_t remaining = 0; // 0 once a frame is complete
+  bool reading = true;
+  size_t len;
+  while (reading && ((len = fread (in, 1, BLOCK_SIZE, stream->raw_file)) > 0))
+  {
+    ZSTD_inBuffer in_buffer = {in, len, 0};
+    while (reading && (in_buffer.pos < in_buffer.size))
+    {
+      ZSTD_outBuffer out_buffer = {out, BLOCK_SIZE, 0};
+      remaining = ZSTD_decompressStream (decompressor, &out_buffer,
+                                         &in_buffer);
+      if (ZSTD_isError (remaining))
+      {
+        ZSTD_freeDStream (decompressor);
+        return false;
+      }
+      reading = write_block (stream->pipe_fd, out, out_buffer.pos);
+    }
+  }
+  ZSTD_freeDStream (decompressor);
+  return !reading || (remaining == 0);
+}
+#endif
+
+/**
+ * This function decompresses the file of a stream to its pipe, and closes
+ * the pipe when done. It runs as the helper thread.
+ * @param arg pointer to the InputStream.
+ * @return NULL.
+ */
+static void *decompress_input (void *arg)
+{
+  InputStream *stream = arg;
+  sigset_t pipe_signal;
+  sigemptyset (&pipe_signal);
+  sigaddset (&pipe_signal, SIGPIPE);
+  // The reader may close the pipe early: writing then fails with EPIPE
+  // instead of killing the process.
+  pthread_sigmask (SIG_BLOCK, &pipe_signal, NULL);
+#ifdef HAVE_ZSTD
+  bool success = (stream->format == ZSTD_INPUT) ? decompress_zstd (stream)
+                                                : decompress_gzip (stream);
+#else
+  bool success = decompress_gzip (stream);
+#endif
+  stream->failed = !success || ferror (stream->raw_file);
+  close (stream->pipe_fd);
+  return NULL;
+}
+
+/**
+ * This function finds the format of a file by its first bytes, and moves
+ * back to its beginning.
+ * @param fp
+ * @return the format.
+ */
+static InputFormat read_input_format (FILE *fp)
+{
+  unsigned char magic[MAGIC_LEN];
+  size_t len = fread (magic, 1, MAGIC_LEN, fp);
+  rewind (fp);
+  if ((len >= GZIP_MAGIC_LEN)
+      && (memcmp (magic, GZIP_MAGIC, GZIP_MAGIC_LEN) == 0))
+  {
+    return GZIP_INPUT;
+  }
+  if ((len >= ZSTD_MAGIC_LEN)
+      && (memcmp (magic, ZSTD_MAGIC, ZSTD_MAGIC_LEN) == 0))
+  {
+    return ZSTD_INPUT;
+  }
+  return PLAIN_INPUT;
+}
+
+InputStream *open_input_stream (const char *path)
+{
+  FILE *fp = fopen (path, "r");
+  if (fp == NULL)
+  {
+    return NULL;
+  }
+  InputStream *stream = malloc (sizeof (InputStream));
+  if (stream == NULL)
+  {
+    fclose (fp);
+    return NULL;
+  }
+  stream->format = read_input_format (fp);
+  stream->failed = false;
+  if (stream->format == PLAIN_INPUT)
+  {
+    stream->fp = fp;
+    stream->raw_file = NULL;
+    return stream;
+  }
+  stream->raw_file = fp;
+  int pipe_fds[2];
+#ifndef HAVE_ZSTD
+  if (stream->format == ZSTD_INPUT)
+  {
+    fclose (fp);
+    free (stream);
+    return NULL;
+  }
+#endif
+  if (pipe (pipe_fds) != 0)
+  {
+    fclose (fp);
+    free (stream);
+    return NULL;
+  }
+  stream->fp = fdopen (pipe_fds[0], "r");
+  stream->pipe_fd = pipe_fds[1];
+  if ((stream->fp == NULL)
+      || (pthread_create (&stream->thread, NULL, decompress_input, stream)
+          != 0))
+  {
+    if (stream->fp != NULL)
+    {
+      fclose (stream->fp);
+    }
+    else
+    {
+      close (pipe_fds[0]);
+    }
+    close (pipe_fds[1]);
+    fclose (fp);
+    free (stream);
+    return NULL;
+  }
+  return stream;
+}
+
+bool close_input_stream (InputStream **ptr_stream)
+{
+  InputStream *stream = *ptr_stream;
+  if (stream == NULL)
+  {
+    return true;
+  }
+  fclose (stream->fp);
+  bool success = true;
+  if (stream->raw_file != NULL)
+  {
+    pthread_join (stream->thread, NULL);
+    fclose (stream->raw_file);
+    success = !stream->failed;
+  }
+  free (stream);
+  *ptr_stream = NULL;
+  return success;
+}
@@ -0,0 +1,46 @@
+#ifndef _INPUT_STREAM_H_
+#define _INPUT_STREAM_H_
+#include <stdio.h> // for FILE
+#include <stdbool.h> // for bool
+#include <pthread.h> // for pthread_t
+
+/**
+ * enum of the formats of an input file, found by its first bytes
+ */
+typedef enum InputFormat {
+    PLAIN_INPUT,
+    GZIP_INPUT,
+    ZSTD_INPUT // only read if built with HAVE_ZSTD
+} InputFormat;
+
+/**
+ * struct holds an open input file. A compressed file is decompressed in
+ * blocks by a helper thread, which writes them to a pipe that fp reads, so
+ * the reader sees the plain text and decompression overlaps with its work.
+ */
+typedef struct InputStream {
+    FILE *fp; // the plain text to read
+    FILE *raw_file; // the compressed file, NULL for a plain file
+    InputFormat format;
+    pthread_t thread; // the helper thread, for a compressed file
+    int pipe_fd; // the end of the pipe the helper thread writes to
+    bool failed; // whether the compressed data was invalid or cut
+} InputStream;
+
+/**
+ * Open an input file for reading, plain, gzip or zstd compressed.
+ * @param path
+ * @return pointer to the new InputStream, NULL if the file can't be opened,
+ * its format is not supported, or in case of allocation failure.
+ */
+InputStream *open_input_stream(const char *path);
+
+/**
+ * Close an input file and stop its helper thread. The file may be closed
+ * before all of it was read.
+ * @param ptr_stream pointer to the stream to close, set to NULL
+ * @return false if the compressed data read was invalid, true otherwise.
+ */
+bool close_input_stream(InputStream **ptr_stream);
+
+#endif //_INPUT_STREAM_H_
@@ -0,0 +1,247 @@
+#include "line_dedup.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#define DELIM " \n\t\r"
+#define MIN_BUCKETS 64
+#define FNV_OFFSET_BASIS 14695981039346656037u
+#define FNV_PRIME 1099511628211u
+#define WORD_SEPARATOR ' '
+#define NUM_OF_MINHASHES 16
+#define NUM_OF_BANDS 4
+#define ROWS_PER_BAND (NUM_OF_MINHASHES / NUM_OF_BANDS)
+#define MIN_SHINGLES 4
+#define GOLDEN_GAMMA 0x9e3779b97f4a7c15u
+#define MIX_MULTIPLIER_1 0xbf58476d1ce4e5b9u
+#define MIX_MULTIPLIER_2 0x94d049bb133111ebu
+#define SLOT_SHIFT 62
+
+/**
+ * This function mixes the bits of a hash, as SplitMix64 does.
+ * @param hash
+ * @return the mixed hash.
+ */
+static uint64_t mix_hash (uint64_t hash)
+{
+  hash = (hash ^ (hash >> 30)) * MIX_MULTIPLIER_1;
+  hash = (hash ^ (hash >> 27)) * MIX_MULTIPLIER_2;
+  return hash ^ (hash >> 31);
+}
+
+/**
+ * This function adds bytes to an FNV-1a hash.
+ * @param hash the hash so far
+ * @param bytes
+ * @param len num of bytes
+ * @param fold_case whether to hash letters in lower case
+ * @return the hash with the bytes.
+ */
+static uint64_t hash_bytes (uint64_t hash, const char *bytes, size_t len,
+                            bool fold_case)
+{
+  for (size_t i = 0; i < len; i++)
+  {
+    unsigned char byte = (unsigned char) bytes[i];
+    hash = (hash ^ (fold_case ? (unsigned char) tolower (byte) : byte))
+           * FNV_PRIME;
+  }
+  return hash;
+}
+
+/**
+ * This function checks whether a set holds a fingerprint. The bucket is
+ * picked from the bits above the lowest one, which marks a used slot.
+ * @param buckets the set
+ * @param num_of_buckets a power of 2
+ * @param fingerprint
+ * @return true if it holds it, false otherwise.
+ */
+static bool has_fingerprint (uint64_t (*buckets)[DEDUP_BUCKET_SLOTS],
+                             size_t num_of_buckets, uint64_t fingerprint)
+{
+  uint64_t *bucket = buckets[(fingerprint >> 1) & (num_of_buckets - 1)];
+  fingerprint |= 1; // 0 marks an empty slot
+  for (int i = 0; i < DEDUP_BUCKET_SLOTS; i++)
+  {
+    if (bucket[i] == fingerprint)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * This function adds a fingerprint to a set. If its bucket is full, it
+ * replaces one of the bucket's fingerprints.
+ * @param buckets the set
+ * @param num_of_buckets a power of 2
+ * @param fingerprint
+ */
+static void add_fingerprint (uint64_t (*buckets)[DEDUP_BUCKET_SLOTS],
+                             size_t num_of_buckets, uint64_t fingerprint)
+{
+  uint64_t *bucket = buckets[(fingerprint >> 1) & (num_of_buckets - 1)];
+  fingerprint |= 1;
+  for (int i = 0; i < DEDUP_BUCKET_SLOTS; i++)
+  {
+    if (bucket[i] == 0)
+    {
+      bucket[i] = fingerprint;
+      return;
+    }
+  }
+  bucket[fingerprint >> SLOT_SHIFT] = fingerprint;
+}
+
+/**
+ * This function finds the next word of a line.
+ * @param line the rest of the line
+ * @param len output, length of the word
+ * @return pointer to the word, NULL if there are no more words.
+ */
+static const char *next_word (const char *line, size_t *len)
+{
+  line += strspn (line, DELIM);
+  if (*line == '\0')
+  {
+    return NULL;
+  }
+  *len = strcspn (line, DELIM);
+  return line;
+}
+
+/**
+ * This function computes the MinHash band keys of a line: the line's
+ * shingles (pairs of consecutive words, ignoring case) are hashed
+ * NUM_OF_MINHASHES ways, the minimum of each way is kept, and every
+ * ROWS_PER_BAND minimums are hashed to a band key.
+ * @param line
+ * @param band_keys output, the keys
+ * @return true if the line has enough shingles to have keys, false otherwise.
+ */
+static bool get_band_keys (const char *line, uint64_t band_keys[NUM_OF_BANDS])
+{
+  uint64_t minhashes[NUM_OF_MINHASHES];
+  for (int i = 0; i < NUM_OF_MINHASHES; i++)
+  {
+    minhashes[i] = UINT64_MAX;
+  }
+  int num_of_shingles = 0;
+  uint64_t prev_word_hash = 0;
+  size_t len;
+  bool first_word = true;
+  for (const char *word = next_word (line, &len); word != NULL;
+       word = next_word (word + len, &len))
+  {
+    uint64_t word_hash = hash_bytes (FNV_OFFSET_BASIS, word, len, true);
+    if (!first_word)
+    {
+      uint64_t shingle = mix_hash (prev_word_hash * GOLDEN_GAMMA + word_hash);
+      for (int i = 0; i < NUM_OF_MINHASHES; i++)
+      {
+        uint64_t hash = mix_hash (shingle + (uint64_t) (i + 1) * GOLDEN_GAMMA);
+        if (hash < minhashes[i])
+        {
+          minhashes[i] = hash;
+        }
+      }
+      num_of_shingles++;
+    }
+    prev_word_hash = word_hash;
+    first_word = false;
+  }
+  if (num_of_shingles < MIN_SHINGLES)
+  {
+    return false;
+  }
+  for (int band = 0; band < NUM_OF_BANDS; band++)
+  {
+    uint64_t key = mix_hash ((uint64_t) band);
+    for (int row = 0; row < ROWS_PER_BAND; row++)
+    {
+      key = mix_hash (key ^ minhashes[band * ROWS_PER_BAND + row]);
+    }
+    band_keys[band] = key;
+  }
+  return true;
+}
+
+LineDedup *create_line_dedup (bool near_duplicates, size_t max_bytes)
+{
+  LineDedup *line_dedup = malloc (sizeof (LineDedup));
+  if (line_dedup == NULL)
+  {
+    return NULL;
+  }
+  size_t bucket_bytes = sizeof (*line_dedup->line_buckets);
+  size_t num_of_sets = near_duplicates ? 2 : 1;
+  size_t num_of_buckets = MIN_BUCKETS;
+  while (2 * num_of_buckets * bucket_bytes * num_of_sets <= max_bytes)
+  {
+    num_of_buckets *= 2;
+  }
+  line_dedup->num_of_buckets = num_of_buckets;
+  line_dedup->line_buckets = calloc (num_of_buckets, bucket_bytes);
+  line_dedup->band_buckets = near_duplicates
+                             ? calloc (num_of_buckets, bucket_bytes) : NULL;
+  line_dedup->num_of_lines = 0;
+  line_dedup->num_of_duplicates = 0;
+  if ((line_dedup->line_buckets == NULL)
+      || (near_duplicates && (line_dedup->band_buckets == NULL)))
+  {
+    free_line_dedup (&line_dedup);
+    return NULL;
+  }
+  return line_dedup;
+}
+
+bool is_duplicate_line (LineDedup *line_dedup, const char *line)
+{
+  line_dedup->num_of_lines++;
+  uint64_t line_hash = FNV_OFFSET_BASIS;
+  size_t len;
+  for (const char *word = next_word (line, &len); word != NULL;
+       word = next_word (word + len, &len))
+  {
+    line_hash = hash_bytes (line_hash, word, len, false);
+    line_hash = (line_hash ^ WORD_SEPARATOR) * FNV_PRIME;
+  }
+  line_hash = mix_hash (line_hash);
+  bool duplicate = has_fingerprint (line_dedup->line_buckets,
+                                    line_dedup->num_of_buckets, line_hash);
+  uint64_t band_keys[NUM_OF_BANDS];
+  bool has_bands = !duplicate && (line_dedup->band_buckets != NULL)
+                   && get_band_keys (line, band_keys);
+  for (int band = 0; has_bands && !duplicate && (band < NUM_OF_BANDS); band++)
+  {
+    duplicate = has_fingerprint (line_dedup->band_buckets,
+                                 line_dedup->num_of_buckets, band_keys[band]);
+  }
+  if (duplicate)
+  {
+    line_dedup->num_of_duplicates++;
+    return true;
+  }
+  add_fingerprint (line_dedup->line_buckets, line_dedup->num_of_buckets,
+                   line_hash);
+  for (int band = 0; has_bands && (band < NUM_OF_BANDS); band++)
+  {
+    add_fingerprint (line_dedup->band_buckets, line_dedup->num_of_buckets,
+                     band_keys[band]);
+  }
+  return false;
+}
+
+void free_line_dedup (LineDedup **ptr_line_dedup)
+{
+  if (*ptr_line_dedup == NULL)
+  {
+    return;
+  }
+  free ((*ptr_line_dedup)->line_buckets);
+  free ((*ptr_line_dedup)->band_buckets);
+  free (*ptr_line_dedup);
+  *ptr_line_dedup = NULL;
+}
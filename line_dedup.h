@@ -0,0 +1,47 @@
+#ifndef _LINE_DEDUP_H_
+#define _LINE_DEDUP_H_
+#include <stdbool.h> // for bool
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint64_t
+
+#define DEDUP_BUCKET_SLOTS 4
+
+/**
+ * struct holds the fingerprints of the lines seen so far, in sets of fixed
+ * size: when a bucket is full, a new fingerprint replaces an old one, so the
+ * oldest lines are slowly forgotten and memory stays bounded
+ */
+typedef struct LineDedup {
+    uint64_t (*line_buckets)[DEDUP_BUCKET_SLOTS]; // exact line hashes
+    uint64_t (*band_buckets)[DEDUP_BUCKET_SLOTS]; // MinHash bands, or NULL
+    size_t num_of_buckets; // of each set, a power of 2
+    long int num_of_lines;
+    long int num_of_duplicates; // exact and near duplicates
+} LineDedup;
+
+/**
+ * Create a new line filter.
+ * @param near_duplicates whether to find near duplicates too, by MinHash
+ * @param max_bytes maximal memory of the fingerprints
+ * @return pointer to the new LineDedup, NULL in case of allocation failure.
+ */
+LineDedup *create_line_dedup(bool near_duplicates, size_t max_bytes);
+
+/**
+ * Check whether a line repeats a line seen before, and remember it if not.
+ * Lines are compared by their words, so they may differ in whitespace. With
+ * near duplicates, lines of enough words whose word pairs are mostly the same,
+ * ignoring case, are duplicates too.
+ * @param line_dedup
+ * @param line the line, not modified
+ * @return true if the line is a duplicate, false otherwise.
+ */
+bool is_duplicate_line(LineDedup *line_dedup, const char *line);
+
+/**
+ * Free a line filter.
+ * @param ptr_line_dedup pointer to the filter to free, set to NULL
+ */
+void free_line_dedup(LineDedup **ptr_line_dedup);
+
+#endif //_LINE_DEDUP_H_
@@ -1,8 +1,15 @@
+#define _POSIX_C_SOURCE 200809L // For rand_r()
 #include "markov_chain.h"
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
+#include <stdint.h>
 
 #define LINE_BREAK "\n"
+#define VARINT_PAYLOAD_BITS 7
+#define VARINT_PAYLOAD_MASK 0x7f
+#define VARINT_CONTINUE_BIT 0x80
+#define MAX_VARINT_LEN 5
 
 /**
  * This function adds the a new node to a markov chain.
@@ -25,6 +32,7 @@ void* add_node_to_markov_chain (MarkovChain *markov_chain, void *data_ptr)
   markov_node->data = node_data;
   markov_node->counter_list = NULL;
   markov_node->num_of_next_nodes = 0;
+  markov_node->frequency = 1;
   if (add (markov_chain->database, markov_node) == 1)
   {
     printf ("%s", ALLOCATION_ERROR_MASSAGE);
@@ -51,9 +59,26 @@ Node* get_node_from_database (MarkovChain *markov_chain, void *data_ptr)
   return NULL;
 }
 
+/**
+ * This function checks if a state is allocated in a block with the other
+ * states of its chain, by compress_markov_chain or append_states_to_database.
+ * The states of a block come first in the database.
+ * @param markov_node
+ * @return true if it is, false if it was allocated alone.
+ */
+static bool is_block_state (const MarkovNode *markov_node)
+{
+  return (markov_node->frequency == PACKED_STATE)
+         | (markov_node->frequency == BLOCK_STATE);
+}
+
 bool add_node_to_counter_list (MarkovNode *first_node, MarkovNode *second_node,
                               MarkovChain *markov_chain)
 {
+  if (is_block_state (first_node))
+  {
+    return false;
+  }
   first_node->counter_list = realloc (first_node->counter_list,
                                       (first_node->num_of_next_nodes + 1)
                                       *sizeof
@@ -90,8 +115,67 @@ Node* add_to_database(MarkovChain *markov_chain, void *data_ptr)
     {
       return NULL;
     }
+    return markov_chain->database->last;
+  }
+  cur_node->data->frequency++;
+  return cur_node;
+}
+
+MarkovNode* append_to_database (MarkovChain *markov_chain, void *data_ptr)
+{
+  return add_node_to_markov_chain (markov_chain, data_ptr);
+}
+
+MarkovNode* append_states_to_database (MarkovChain *markov_chain,
+                                       const void *data, size_t data_size,
+                                       int num_of_states,
+                                       const int *num_of_next_nodes)
+{
+  LinkedList *database = markov_chain->database;
+  if ((database->size > 0) || (num_of_states <= 0))
+  {
+    return NULL;
+  }
+  long int num_of_counters = 0;
+  for (int i = 0; i < num_of_states; i++)
+  {
+    num_of_counters += num_of_next_nodes[i];
+  }
+  // the list nodes come first, so the block is freed through database->first
+  Node *list_nodes = malloc (num_of_states * (sizeof (Node)
+                                              + sizeof (MarkovNode))
+                             + num_of_counters * sizeof (NextNodeCounter));
+  if (list_nodes == NULL)
+  {
+    printf ("%s", ALLOCATION_ERROR_MASSAGE);
+    return NULL;
+  }
+  MarkovNode *states = (MarkovNode *) (list_nodes + num_of_states);
+  NextNodeCounter *counters = (NextNodeCounter *) (states + num_of_states);
+  for (int i = 0; i < num_of_states; i++)
+  {
+    MarkovNode *markov_node = &states[i];
+    markov_node->data = markov_chain->copy_func ((const char *) data
+                                                 + i * data_size);
+    markov_node->counter_list = (num_of_next_nodes[i] > 0) ? counters : NULL;
+    markov_node->num_of_next_nodes = num_of_next_nodes[i];
+    markov_node->frequency = BLOCK_STATE;
+    counters += num_of_next_nodes[i];
+    list_nodes[i].data = markov_node;
+    list_nodes[i].next = (i + 1 < num_of_states) ? &list_nodes[i + 1] : NULL;
   }
-  return markov_chain->database->last;
+  database->first = list_nodes;
+  database->last = &list_nodes[num_of_states - 1];
+  database->size = num_of_states;
+  return states;
+}
+
+void set_counter_list (MarkovNode *markov_node, NextNodeCounter *counter_list,
+                       int num_of_next_nodes)
+{
+  free (markov_node->counter_list);
+  markov_node->counter_list = counter_list;
+  markov_node->num_of_next_nodes = num_of_next_nodes;
 }
 
 /**
@@ -104,29 +188,212 @@ int get_random_number(int max_number)
   return rand() % max_number;
 }
 
-MarkovNode* get_first_random_node(MarkovChain *markov_chain)
+/**
+* Get random number between 0 and max_number [0, max_number), from the given
+* random state if there is one, or from the global one otherwise.
+* @param max_number maximal number to return (not including)
+* @param seed random state of the caller, NULL to use rand()
+* @return Random number
+*/
+static int get_random_number_r (int max_number, unsigned int *seed)
+{
+  if (seed == NULL)
+  {
+    return get_random_number (max_number);
+  }
+  return rand_r (seed) % max_number;
+}
+
+/**
+ * This function chooses a random first state, as get_first_random_node does.
+ * States that end a sequence right away are drawn again.
+ * @param markov_chain
+ * @param seed random state of the caller, NULL to use rand()
+ * @return MarkovNode of the chosen state
+ */
+static MarkovNode* choose_first_node (MarkovChain *markov_chain,
+                                      unsigned int *seed)
 {
-  int random_num = get_random_number (markov_chain->database->size);
+  if (markov_chain->database->size == 0)
+  {
+    return NULL;
+  }
+  int random_num = get_random_number_r (markov_chain->database->size, seed);
   Node *random_node = markov_chain->database->first;
   for (int cur_index = 0; cur_index < random_num; cur_index++)
   {
     random_node = random_node->next;
   }
-  if (markov_chain->is_last (random_node->data->data) == true)
+  if ((markov_chain->is_last (random_node->data->data) == true)
+      || (random_node->data->num_of_next_nodes == 0))
   {
-    return get_first_random_node (markov_chain);
+    return choose_first_node (markov_chain, seed);
   }
     return random_node->data;
 }
 
-MarkovNode* get_next_random_node (MarkovNode *state_struct_ptr)
+MarkovNode* get_first_random_node(MarkovChain *markov_chain)
+{
+  return choose_first_node (markov_chain, NULL);
+}
+
+/**
+ * This function reads a single varint.
+ * @param bytes the varint to read
+ * @param value output, the value of the varint
+ * @return pointer to the byte after the varint.
+ */
+static const unsigned char *read_varint (const unsigned char *bytes,
+                                         unsigned int *value)
+{
+  unsigned int result = 0;
+  int shift = 0;
+  while (*bytes & VARINT_CONTINUE_BIT)
+  {
+    result |= (unsigned int) (*bytes & VARINT_PAYLOAD_MASK) << shift;
+    shift += VARINT_PAYLOAD_BITS;
+    bytes++;
+  }
+  *value = result | ((unsigned int) *bytes << shift);
+  return bytes + 1;
+}
+
+/**
+ * This function maps the offset of a next state to the value of a varint,
+ * small offsets of both signs to small values.
+ * @param offset
+ * @return the value to write.
+ */
+static unsigned int encode_offset (long int offset)
+{
+  return (offset < 0) ? (unsigned int) -offset * 2 - 1
+                      : (unsigned int) offset * 2;
+}
+
+/**
+ * This function maps the value of a varint back to the offset of a next
+ * state, as encode_offset wrote it.
+ * @param value
+ * @return the offset.
+ */
+static long int decode_offset (unsigned int value)
+{
+  return (value % 2 == 1) ? -(long int) (value / 2) - 1
+                          : (long int) (value / 2);
+}
+
+/**
+ * struct holds the position of a walk over a counter list, plain or
+ * compressed
+ */
+typedef struct CounterCursor {
+    MarkovNode *markov_node;
+    int index; // of the next counter
+    const unsigned char *bytes; // the next varint pair, if compressed
+    long int offset; // of the last state read from markov_node, if compressed
+} CounterCursor;
+
+/**
+ * This function starts a walk over the counter list of a node.
+ * @param markov_node
+ * @param total_frequency output, the sum of the frequencies, if compressed
+ * @return cursor to the first counter.
+ */
+static CounterCursor start_counter_list (MarkovNode *markov_node,
+                                         unsigned int *total_frequency)
+{
+  CounterCursor cursor = {markov_node, 0, NULL, 0};
+  if ((markov_node->frequency == PACKED_STATE)
+      && (markov_node->num_of_next_nodes > 0))
+  {
+    cursor.bytes = read_varint (markov_node->packed_list, total_frequency);
+  }
+  return cursor;
+}
+
+/**
+ * This function reads the next counter of a walk over a counter list. The
+ * next states of a compressed list are found by their offset from the node,
+ * as the states of a compressed chain share a single array.
+ * @param cursor
+ * @param counter output, the next state and its frequency
+ * @return true if a counter was read, false at the end of the list.
+ */
+static bool read_next_counter (CounterCursor *cursor,
+                               NextNodeCounter *counter)
+{
+  MarkovNode *markov_node = cursor->markov_node;
+  if (cursor->index == markov_node->num_of_next_nodes)
+  {
+    return false;
+  }
+  cursor->index++;
+  if (cursor->bytes == NULL)
+  {
+    *counter = markov_node->counter_list[cursor->index - 1];
+    return true;
+  }
+  unsigned int delta, frequency;
+  cursor->bytes = read_varint (read_varint (cursor->bytes, &delta),
+                               &frequency);
+  // the first offset is from the node itself, the others from the last one
+  cursor->offset = (cursor->index == 1) ? decode_offset (delta)
+                                        : cursor->offset + delta;
+  counter->markov_node = markov_node + cursor->offset;
+  counter->frequency = (int) frequency;
+  return true;
+}
+
+/**
+ * This function chooses the next state of a compressed markov node. It
+ * decodes the counter list only up to the chosen state.
+ * @param markov_node the node to choose from
+ * @param seed random state of the caller, NULL to use rand()
+ * @return MarkovNode of the chosen state
+ */
+static MarkovNode *get_next_packed_node (MarkovNode *markov_node,
+                                         unsigned int *seed)
+{
+  unsigned int total_frequency = 0;
+  CounterCursor cursor = start_counter_list (markov_node, &total_frequency);
+  if (total_frequency == 0)
+  {
+    return NULL;
+  }
+  int random_num = get_random_number_r ((int) total_frequency, seed);
+  NextNodeCounter next_node;
+  long int cur_iter = 0;
+  while (read_next_counter (&cursor, &next_node))
+  {
+    cur_iter += next_node.frequency;
+    if (cur_iter > random_num)
+    {
+      return next_node.markov_node;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * This function chooses the next state of a markov node that was not
+ * compressed.
+ * @param state_struct_ptr the node to choose from
+ * @param seed random state of the caller, NULL to use rand()
+ * @return MarkovNode of the chosen state
+ */
+static MarkovNode *get_next_plain_node (MarkovNode *state_struct_ptr,
+                                        unsigned int *seed)
 {
   int counter = 0;
   for (int i = 0; i < state_struct_ptr->num_of_next_nodes; i++)
   {
     counter += state_struct_ptr->counter_list[i].frequency;
   }
-  int random_num = get_random_number (counter);
+  if (counter == 0)
+  {
+    return NULL;
+  }
+  int random_num = get_random_number_r (counter, seed);
   MarkovNode *random_markov_node;
   long int cur_iter = 0;
   for (int j = 0; j < state_struct_ptr->num_of_next_nodes; j++)
@@ -141,20 +408,59 @@ MarkovNode* get_next_random_node (MarkovNode *state_struct_ptr)
   return NULL;
 }
 
+MarkovNode* get_next_random_node (MarkovNode *state_struct_ptr)
+{
+  return get_next_random_node_r (state_struct_ptr, NULL);
+}
+
+MarkovNode* get_next_random_node_r (MarkovNode *state_struct_ptr,
+                                    unsigned int *seed)
+{
+  if (state_struct_ptr->frequency == PACKED_STATE)
+  {
+    return get_next_packed_node (state_struct_ptr, seed);
+  }
+  return get_next_plain_node (state_struct_ptr, seed);
+}
+
+/**
+ * This function checks if a generated sequence may go on after a node.
+ * @param markov_chain
+ * @param last_node the last node of the sequence so far
+ * @param num_of_words num of words in the sequence so far
+ * @param max_length maximum length of the sequence
+ * @return true if another node should be generated, false otherwise.
+ */
+static bool can_continue_sequence (MarkovChain *markov_chain,
+                                   MarkovNode *last_node, int num_of_words,
+                                   int max_length)
+{
+  return (num_of_words < max_length) &
+         (markov_chain->is_last (last_node->data) == false) &
+         (last_node->num_of_next_nodes > 0);
+}
+
 void generate_random_sequence (MarkovChain *markov_chain, MarkovNode *
 first_node, int max_length)
 {
   if (first_node == NULL)
   {
     first_node = get_first_random_node (markov_chain);
+    if (first_node == NULL)
+    {
+      return;
+    }
   }
   markov_chain->print_func (first_node->data);
   MarkovNode *next_node = get_next_random_node (first_node);
+  if (next_node == NULL)
+  {
+    return;
+  }
   markov_chain->print_func (next_node->data);
   int num_of_words = 2;
-  while ((num_of_words < max_length) &
-         (markov_chain->is_last (next_node->data) == false) &
-         (next_node->num_of_next_nodes > 0))
+  while (can_continue_sequence (markov_chain, next_node, num_of_words,
+                                max_length))
   {
     next_node = get_next_random_node (next_node);
     markov_chain->print_func (next_node->data);
@@ -162,19 +468,1138 @@ first_node, int max_length)
   }
 }
 
+int generate_random_sequence_to_array (MarkovChain *markov_chain,
+                                       MarkovNode *first_node, int max_length,
+                                       MarkovNode **sequence)
+{
+  return generate_random_sequence_to_array_r (markov_chain, first_node,
+                                              max_length, sequence, NULL);
+}
+
+int generate_random_sequence_to_array_r (MarkovChain *markov_chain,
+                                         MarkovNode *first_node,
+                                         int max_length,
+                                         MarkovNode **sequence,
+                                         unsigned int *seed)
+{
+  if (first_node == NULL)
+  {
+    first_node = choose_first_node (markov_chain, seed);
+    if (first_node == NULL)
+    {
+      return 0;
+    }
+  }
+  sequence[0] = first_node;
+  MarkovNode *next_node = get_next_random_node_r (first_node, seed);
+  if (next_node == NULL)
+  {
+    return 1;
+  }
+  sequence[1] = next_node;
+  int num_of_words = 2;
+  while (can_continue_sequence (markov_chain, next_node, num_of_words,
+                                max_length))
+  {
+    next_node = get_next_random_node_r (next_node, seed);
+    sequence[num_of_words] = next_node;
+    num_of_words++;
+  }
+  return num_of_words;
+}
+
+void generate_random_sequences (MarkovChain *markov_chain,
+                                MarkovNode *first_node, int max_length,
+                                int num_of_sequences, MarkovNode **sequences,
+                                int *lengths)
+{
+  for (int i = 0; i < num_of_sequences; i++)
+  {
+    lengths[i] = generate_random_sequence_to_array (
+        markov_chain, first_node, max_length,
+        sequences + (long int) i * max_length);
+  }
+}
+
+/**
+ * This function frees a single markov node that was allocated alone, and all
+ * of its content.
+ * @param markov_chain the chain the node belongs to
+ * @param markov_node the node to free
+ */
+static void free_markov_node (MarkovChain *markov_chain,
+                              MarkovNode *markov_node)
+{
+  markov_chain->free_data (markov_node->data);
+  free (markov_node->counter_list);
+  free (markov_node);
+}
+
+/**
+ * This function scales down and evicts the transitions of a single surviving
+ * state. Transitions to evicted states are dropped as well.
+ * @param markov_node the state whose counter list is decayed
+ * @param decay_factor factor to multiply every frequency by
+ * @param min_frequency lowest frequency a transition or a state may keep
+ */
+static void decay_counter_list (MarkovNode *markov_node, double decay_factor,
+                                int min_frequency)
+{
+  int kept = 0;
+  for (int i = 0; i < markov_node->num_of_next_nodes; i++)
+  {
+    NextNodeCounter counter = markov_node->counter_list[i];
+    counter.frequency = (int) (counter.frequency * decay_factor);
+    if ((counter.frequency >= min_frequency) &
+        (counter.markov_node->frequency >= min_frequency))
+    {
+      markov_node->counter_list[kept] = counter;
+      kept++;
+    }
+  }
+  if (kept == 0)
+  {
+    free (markov_node->counter_list);
+    markov_node->counter_list = NULL;
+  }
+  else if (kept < markov_node->num_of_next_nodes)
+  {
+    NextNodeCounter *shrunk = realloc (markov_node->counter_list,
+                                       kept * sizeof (NextNodeCounter));
+    if (shrunk != NULL)
+    {
+      markov_node->counter_list = shrunk;
+    }
+  }
+  markov_node->num_of_next_nodes = kept;
+}
+
+int decay_markov_chain (MarkovChain *markov_chain, double decay_factor,
+                        int min_frequency)
+{
+  Node *cur_node = markov_chain->database->first;
+  if ((cur_node != NULL) && is_block_state (cur_node->data))
+  {
+    return 0;
+  }
+  if (min_frequency < 1)
+  {
+    min_frequency = 1;
+  }
+  while (cur_node != NULL)
+  {
+    cur_node->data->frequency = (int) (cur_node->data->frequency
+                                       * decay_factor);
+    cur_node = cur_node->next;
+  }
+  for (cur_node = markov_chain->database->first; cur_node != NULL;
+       cur_node = cur_node->next)
+  {
+    if (cur_node->data->frequency >= min_frequency)
+    {
+      decay_counter_list (cur_node->data, decay_factor, min_frequency);
+    }
+  }
+  int evicted = 0;
+  Node *prev_node = NULL;
+  cur_node = markov_chain->database->first;
+  while (cur_node != NULL)
+  {
+    Node *next_node = cur_node->next;
+    if (cur_node->data->frequency < min_frequency)
+    {
+      if (prev_node == NULL)
+      {
+        markov_chain->database->first = next_node;
+      }
+      else
+      {
+        prev_node->next = next_node;
+      }
+      free_markov_node (markov_chain, cur_node->data);
+      free (cur_node);
+      evicted++;
+    }
+    else
+    {
+      prev_node = cur_node;
+    }
+    cur_node = next_node;
+  }
+  markov_chain->database->last = prev_node;
+  markov_chain->database->size -= evicted;
+  return evicted;
+}
+
 void free_markov_chain(MarkovChain ** ptr_chain)
 {
   Node *cur_node = (*ptr_chain)->database->first;
   Node *temp;
+  // a block starts with its list nodes, and its states come first
+  Node *block = ((cur_node != NULL) && is_block_state (cur_node->data))
+                ? cur_node : NULL;
   while (cur_node != NULL)
   {
-    free (cur_node->data->data);
-    free (cur_node->data->counter_list);
-    (*ptr_chain)->free_data (cur_node->data);
     temp = cur_node->next;
-    free (cur_node);
+    if (is_block_state (cur_node->data))
+    {
+      (*ptr_chain)->free_data (cur_node->data->data);
+    }
+    else
+    {
+      free_markov_node (*ptr_chain, cur_node->data);
+      free (cur_node);
+    }
     cur_node = temp;
   }
+  free (block);
   free ((*ptr_chain)->database);
   free (*ptr_chain);
-}
\ No newline at end of file
+}
+
+/**
+ * This function sorts states by their data, using a merge sort so the chain's
+ * comp_func can be used as the order.
+ * @param states the states to sort
+ * @param temp buffer of the same size as states
+ * @param num_of_states num of states to sort
+ * @param comp_func the order of the data
+ */
+static void sort_states (MarkovNode **states, MarkovNode **temp,
+                         int num_of_states, comp_f comp_func)
+{
+  if (num_of_states < 2)
+  {
+    return;
+  }
+  int middle = num_of_states / 2;
+  sort_states (states, temp, middle, comp_func);
+  sort_states (states + middle, temp, num_of_states - middle, comp_func);
+  int left = 0, right = middle, merged = 0;
+  while ((left < middle) & (right < num_of_states))
+  {
+    if (comp_func (states[right]->data, states[left]->data) < 0)
+    {
+      temp[merged++] = states[right++];
+    }
+    else
+    {
+      temp[merged++] = states[left++];
+    }
+  }
+  while (left < middle)
+  {
+    temp[merged++] = states[left++];
+  }
+  while (right < num_of_states)
+  {
+    temp[merged++] = states[right++];
+  }
+  memcpy (states, temp, num_of_states * sizeof (MarkovNode *));
+}
+
+/**
+ * This function finds the index of data_ptr in the scorer's sorted states.
+ * @param scorer
+ * @param data_ptr the state to look for
+ * @return index of the state, -1 if not in the chain.
+ */
+static int find_state_index (const MarkovScorer *scorer, const void *data_ptr)
+{
+  int low = 0, high = scorer->num_of_states - 1;
+  while (low <= high)
+  {
+    int middle = low + (high - low) / 2;
+    int comp = scorer->markov_chain->comp_func (scorer->states[middle]->data,
+                                                data_ptr);
+    if (comp == 0)
+    {
+      return middle;
+    }
+    if (comp < 0)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle - 1;
+    }
+  }
+  return -1;
+}
+
+/**
+ * This function finds the log-probability of a transition in the scorer.
+ * @param scorer
+ * @param from index of the first state
+ * @param to index of the second state
+ * @param log_prob output, the log-probability of the transition
+ * @return true if the transition occurred in training, false otherwise.
+ */
+static bool find_transition (const MarkovScorer *scorer, int from, int to,
+                             double *log_prob)
+{
+  int low = scorer->next_start[from], high = scorer->next_start[from + 1] - 1;
+  while (low <= high)
+  {
+    int middle = low + (high - low) / 2;
+    if (scorer->next_ids[middle] == to)
+    {
+      *log_prob = scorer->next_log_prob[middle];
+      return true;
+    }
+    if (scorer->next_ids[middle] < to)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle - 1;
+    }
+  }
+  return false;
+}
+
+/**
+ * struct pairs a successor index with its log-probability while sorting
+ */
+typedef struct ScoredTransition {
+    int id;
+    double log_prob;
+} ScoredTransition;
+
+/**
+ * This function compares 2 scored transitions by their successor index.
+ */
+static int comp_scored_transitions (const void *data_1, const void *data_2)
+{
+  const ScoredTransition *transition_1 = data_1;
+  const ScoredTransition *transition_2 = data_2;
+  return (transition_1->id > transition_2->id)
+         - (transition_1->id < transition_2->id);
+}
+
+/**
+ * This function fills the successor tables of the scorer, once its states are
+ * sorted.
+ * @param scorer
+ * @param transitions buffer with a place for every transition of the chain
+ * @param counters buffer with a place for the largest counter list
+ */
+static void fill_scorer_transitions (MarkovScorer *scorer,
+                                     ScoredTransition *transitions,
+                                     NextNodeCounter *counters)
+{
+  int num_of_transitions = 0;
+  for (int i = 0; i < scorer->num_of_states; i++)
+  {
+    MarkovNode *markov_node = scorer->states[i];
+    scorer->next_start[i] = num_of_transitions;
+    unpack_counter_list (markov_node, counters);
+    long int total = 0;
+    for (int j = 0; j < markov_node->num_of_next_nodes; j++)
+    {
+      total += counters[j].frequency;
+    }
+    double log_normalizer = log ((double) total);
+    ScoredTransition *first = transitions + num_of_transitions;
+    for (int j = 0; j < markov_node->num_of_next_nodes; j++)
+    {
+      NextNodeCounter counter = counters[j];
+      first[j].id = find_state_index (scorer, counter.markov_node->data);
+      first[j].log_prob = log ((double) counter.frequency) - log_normalizer;
+    }
+    qsort (first, markov_node->num_of_next_nodes, sizeof (ScoredTransition),
+           comp_scored_transitions);
+    num_of_transitions += markov_node->num_of_next_nodes;
+  }
+  scorer->next_start[scorer->num_of_states] = num_of_transitions;
+  for (int i = 0; i < num_of_transitions; i++)
+  {
+    scorer->next_ids[i] = transitions[i].id;
+    scorer->next_log_prob[i] = transitions[i].log_prob;
+  }
+}
+
+MarkovScorer* create_markov_scorer (MarkovChain *markov_chain)
+{
+  MarkovScorer *scorer = calloc (1, sizeof (MarkovScorer));
+  if (scorer == NULL)
+  {
+    printf ("%s", ALLOCATION_ERROR_MASSAGE);
+    return NULL;
+  }
+  int num_of_states = markov_chain->database->size;
+  long int num_of_transitions = 0;
+  int max_next_nodes = 0;
+  for (Node *cur_node = markov_chain->database->first; cur_node != NULL;
+       cur_node = cur_node->next)
+  {
+    num_of_transitions += cur_node->data->num_of_next_nodes;
+    if (cur_node->data->num_of_next_nodes > max_next_nodes)
+    {
+      max_next_nodes = cur_node->data->num_of_next_nodes;
+    }
+  }
+  scorer->markov_chain = markov_chain;
+  scorer->num_of_states = num_of_states;
+  scorer->states = malloc ((num_of_states + 1) * sizeof (MarkovNode *));
+  scorer->next_start = malloc ((num_of_states + 1) * sizeof (int));
+  scorer->next_ids = malloc ((num_of_transitions + 1) * sizeof (int));
+  scorer->next_log_prob = malloc ((num_of_transitions + 1) * sizeof (double));
+  MarkovNode **temp = malloc ((num_of_states + 1) * sizeof (MarkovNode *));
+  ScoredTransition *transitions = malloc ((num_of_transitions + 1)
+                                          * sizeof (ScoredTransition));
+  NextNodeCounter *counters = malloc ((max_next_nodes + 1)
+                                      * sizeof (NextNodeCounter));
+  if ((scorer->states == NULL) | (scorer->next_start == NULL)
+      | (scorer->next_ids == NULL) | (scorer->next_log_prob == NULL)
+      | (temp == NULL) | (transitions == NULL) | (counters == NULL))
+  {
+    printf ("%s", ALLOCATION_ERROR_MASSAGE);
+    free (temp);
+    free (transitions);
+    free (counters);
+    free_markov_scorer (&scorer);
+    return NULL;
+  }
+  int index = 0;
+  for (Node *cur_node = markov_chain->database->first; cur_node != NULL;
+       cur_node = cur_node->next)
+  {
+    scorer->states[index++] = cur_node->data;
+  }
+  sort_states (scorer->states, temp, num_of_states, markov_chain->comp_func);
+  fill_scorer_transitions (scorer, transitions, counters);
+  free (temp);
+  free (transitions);
+  free (counters);
+  return scorer;
+}
+
+SequenceScore score_sequence (const MarkovScorer *scorer, void **sequence,
+                              int length)
+{
+  SequenceScore score = {0, 0, 0, 0};
+  int prev_id = -1;
+  for (int i = 0; i < length; i++)
+  {
+    int cur_id = find_state_index (scorer, sequence[i]);
+    if ((i > 0) && (scorer->markov_chain->is_last (sequence[i - 1]) == false))
+    {
+      double log_prob;
+      score.num_of_transitions++;
+      if ((prev_id != -1) && (cur_id != -1)
+          && find_transition (scorer, prev_id, cur_id, &log_prob))
+      {
+        score.log_prob += log_prob;
+      }
+      else
+      {
+        score.num_of_unseen++;
+      }
+    }
+    prev_id = cur_id;
+  }
+  int num_of_seen = score.num_of_transitions - score.num_of_unseen;
+  score.perplexity = (num_of_seen > 0) ? exp (-score.log_prob / num_of_seen)
+                                       : INFINITY;
+  return score;
+}
+
+void free_markov_scorer (MarkovScorer **scorer)
+{
+  if (*scorer == NULL)
+  {
+    return;
+  }
+  free ((*scorer)->states);
+  free ((*scorer)->next_start);
+  free ((*scorer)->next_ids);
+  free ((*scorer)->next_log_prob);
+  free (*scorer);
+  *scorer = NULL;
+}
+
+/**
+ * struct pairs a markov node with its id, to find the ids of nodes by their
+ * address
+ */
+typedef struct StateId {
+    MarkovNode *markov_node;
+    int id;
+} StateId;
+
+/**
+ * This function compares 2 state ids by the address of their node.
+ */
+static int comp_state_ids (const void *data_1, const void *data_2)
+{
+  uintptr_t node_1 = (uintptr_t) ((const StateId *) data_1)->markov_node;
+  uintptr_t node_2 = (uintptr_t) ((const StateId *) data_2)->markov_node;
+  return (node_1 > node_2) - (node_1 < node_2);
+}
+
+/**
+ * This function finds the id of a state among state ids sorted by node
+ * address.
+ * @param state_ids
+ * @param num_of_states
+ * @param markov_node the state to look for, one of state_ids
+ * @return id of the state.
+ */
+static int find_state_id (const StateId *state_ids, int num_of_states,
+                          MarkovNode *markov_node)
+{
+  StateId key = {markov_node, 0};
+  const StateId *found = bsearch (&key, state_ids, num_of_states,
+                                  sizeof (StateId), comp_state_ids);
+  return found->id;
+}
+
+/**
+ * This function compares 2 (id, frequency) pairs by their id.
+ */
+static int comp_packed_ids (const void *data_1, const void *data_2)
+{
+  const unsigned int *counter_1 = data_1;
+  const unsigned int *counter_2 = data_2;
+  return (counter_1[0] > counter_2[0]) - (counter_1[0] < counter_2[0]);
+}
+
+/**
+ * This function writes a single varint.
+ * @param bytes where to write the varint, at least MAX_VARINT_LEN bytes
+ * @param value the value to write
+ * @return pointer to the byte after the varint.
+ */
+static unsigned char *write_varint (unsigned char *bytes, unsigned int value)
+{
+  while (value > VARINT_PAYLOAD_MASK)
+  {
+    *bytes = (unsigned char) ((value & VARINT_PAYLOAD_MASK)
+                              | VARINT_CONTINUE_BIT);
+    value >>= VARINT_PAYLOAD_BITS;
+    bytes++;
+  }
+  *bytes = (unsigned char) value;
+  return bytes + 1;
+}
+
+/**
+ * This function encodes the counter list of a single markov node: the sum of
+ * its frequencies, then its next states' ids, sorted, as deltas, each with
+ * its frequency. The first id is written as an offset from the node's own.
+ * @param markov_node the node to encode
+ * @param id of the node
+ * @param state_ids the ids of all the states, sorted by node address
+ * @param num_of_states
+ * @param pairs buffer of 2 * num_of_next_nodes ids and frequencies
+ * @param bytes where to write the encoding, at least
+ * (2 * num_of_next_nodes + 1) * MAX_VARINT_LEN bytes
+ * @return num of bytes written.
+ */
+static long int encode_counter_list (const MarkovNode *markov_node, int id,
+                                     const StateId *state_ids,
+                                     int num_of_states, unsigned int *pairs,
+                                     unsigned char *bytes)
+{
+  int num_of_next_nodes = markov_node->num_of_next_nodes;
+  if (num_of_next_nodes == 0)
+  {
+    return 0;
+  }
+  unsigned int total_frequency = 0;
+  for (int i = 0; i < num_of_next_nodes; i++)
+  {
+    pairs[2 * i] = (unsigned int) find_state_id (
+        state_ids, num_of_states, markov_node->counter_list[i].markov_node);
+    pairs[2 * i + 1] = (unsigned int) markov_node->counter_list[i].frequency;
+    total_frequency += pairs[2 * i + 1];
+  }
+  qsort (pairs, num_of_next_nodes, 2 * sizeof (unsigned int),
+         comp_packed_ids);
+  unsigned char *end = write_varint (bytes, total_frequency);
+  end = write_varint (end, encode_offset ((long int) pairs[0] - id));
+  end = write_varint (end, pairs[1]);
+  for (int i = 1; i < num_of_next_nodes; i++)
+  {
+    end = write_varint (end, pairs[2 * i] - pairs[2 * i - 2]);
+    end = write_varint (end, pairs[2 * i + 1]);
+  }
+  return end - bytes;
+}
+
+/**
+ * This function encodes the counter lists of all the states one after the
+ * other into a single buffer.
+ * @param markov_chain
+ * @param state_ids the ids of all the states, sorted by node address
+ * @param offsets output, where the encoding of each state starts
+ * @param max_next_nodes size of the largest counter list
+ * @param num_of_bytes output, size of the encoding
+ * @return the dynamically allocated encoding, NULL in case of allocation
+ * failure.
+ */
+static unsigned char *encode_counter_lists (MarkovChain *markov_chain,
+                                            const StateId *state_ids,
+                                            long int *offsets,
+                                            int max_next_nodes,
+                                            long int *num_of_bytes)
+{
+  int num_of_states = markov_chain->database->size;
+  long int max_list_bytes = (2L * max_next_nodes + 1) * MAX_VARINT_LEN;
+  long int capacity = max_list_bytes + num_of_states + 1;
+  unsigned char *bytes = malloc (capacity);
+  unsigned int *pairs = malloc ((2 * max_next_nodes + 1)
+                                * sizeof (unsigned int));
+  if ((bytes == NULL) | (pairs == NULL))
+  {
+    free (bytes);
+    free (pairs);
+    return NULL;
+  }
+  long int size = 0;
+  int id = 0;
+  for (Node *cur_node = markov_chain->database->first; cur_node != NULL;
+       cur_node = cur_node->next, id++)
+  {
+    if (capacity - size < max_list_bytes)
+    {
+      capacity = 2 * capacity + max_list_bytes;
+      unsigned char *grown = realloc (bytes, capacity);
+      if (grown == NULL)
+      {
+        free (bytes);
+        free (pairs);
+        return NULL;
+      }
+      bytes = grown;
+    }
+    offsets[id] = size;
+    size += encode_counter_list (cur_node->data, id, state_ids,
+                                 num_of_states, pairs, bytes + size);
+  }
+  free (pairs);
+  *num_of_bytes = size;
+  return bytes;
+}
+
+/**
+ * This function frees the states of a chain once they were moved to a block,
+ * leaving their data.
+ * @param first the first list node of the chain
+ */
+static void free_moved_states (Node *first)
+{
+  Node *block = is_block_state (first->data) ? first : NULL;
+  Node *cur_node = first;
+  while (cur_node != NULL)
+  {
+    Node *next_node = cur_node->next;
+    if (!is_block_state (cur_node->data))
+    {
+      free (cur_node->data->counter_list);
+      free (cur_node->data);
+      free (cur_node);
+    }
+    cur_node = next_node;
+  }
+  free (block); // the counter lists of its states are freed with it
+}
+
+bool compress_markov_chain (MarkovChain *markov_chain)
+{
+  Node *first = markov_chain->database->first;
+  if ((first == NULL) || (first->data->frequency == PACKED_STATE))
+  {
+    return true;
+  }
+  int num_of_states = markov_chain->database->size;
+  int max_next_nodes = 0;
+  for (Node *cur_node = first; cur_node != NULL; cur_node = cur_node->next)
+  {
+    if (cur_node->data->num_of_next_nodes > max_next_nodes)
+    {
+      max_next_nodes = cur_node->data->num_of_next_nodes;
+    }
+  }
+  StateId *state_ids = malloc (num_of_states * sizeof (StateId));
+  long int *offsets = malloc (num_of_states * sizeof (long int));
+  if ((state_ids == NULL) | (offsets == NULL))
+  {
+    printf ("%s", ALLOCATION_ERROR_MASSAGE);
+    free (state_ids);
+    free (offsets);
+    return false;
+  }
+  int id = 0;
+  for (Node *cur_node = first; cur_node != NULL; cur_node = cur_node->next)
+  {
+    state_ids[id] = (StateId) {cur_node->data, id};
+    id++;
+  }
+  qsort (state_ids, num_of_states, sizeof (StateId), comp_state_ids);
+  long int num_of_bytes = 0;
+  unsigned char *bytes = encode_counter_lists (markov_chain, state_ids,
+                                               offsets, max_next_nodes,
+                                               &num_of_bytes);
+  free (state_ids);
+  // the list nodes come first, so the block is freed through database->first
+  Node *list_nodes = (bytes == NULL) ? NULL
+      : malloc (num_of_states * (sizeof (Node) + sizeof (MarkovNode))
+                + num_of_bytes);
+  if (list_nodes == NULL)
+  {
+    printf ("%s", ALLOCATION_ERROR_MASSAGE);
+    free (bytes);
+    free (offsets);
+    return false;
+  }
+  MarkovNode *states = (MarkovNode *) (list_nodes + num_of_states);
+  unsigned char *packed_lists = (unsigned char *) (states + num_of_states);
+  memcpy (packed_lists, bytes, num_of_bytes);
+  free (bytes);
+  id = 0;
+  for (Node *cur_node = first; cur_node != NULL; cur_node = cur_node->next)
+  {
+    int num_of_next_nodes = cur_node->data->num_of_next_nodes;
+    states[id].data = cur_node->data->data;
+    states[id].packed_list = (num_of_next_nodes > 0)
+                             ? packed_lists + offsets[id] : NULL;
+    states[id].num_of_next_nodes = num_of_next_nodes;
+    states[id].frequency = PACKED_STATE;
+    list_nodes[id].data = &states[id];
+    list_nodes[id].next = (id + 1 < num_of_states) ? &list_nodes[id + 1]
+                                                   : NULL;
+    id++;
+  }
+  free (offsets);
+  free_moved_states (first);
+  markov_chain->database->first = list_nodes;
+  markov_chain->database->last = &list_nodes[num_of_states - 1];
+  return true;
+}
+
+void unpack_counter_list (MarkovNode *markov_node,
+                          NextNodeCounter *counter_list)
+{
+  unsigned int total_frequency;
+  CounterCursor cursor = start_counter_list (markov_node, &total_frequency);
+  int i = 0;
+  while (read_next_counter (&cursor, &counter_list[i]))
+  {
+    i++;
+  }
+}
+
+/**
+ * This function copies the counter lists of a chain into its copy.
+ * @param markov_chain the chain to copy
+ * @param copies the states of the copy, by database order
+ * @param state_ids the ids of the chain's states, sorted by node address
+ * @param counters buffer with a place for the largest counter list
+ * @return true on success, false in case of allocation failure.
+ */
+static bool copy_counter_lists (MarkovChain *markov_chain,
+                                MarkovNode **copies, const StateId *state_ids,
+                                NextNodeCounter *counters)
+{
+  int num_of_states = markov_chain->database->size;
+  int id = 0;
+  for (Node *cur_node = markov_chain->database->first; cur_node != NULL;
+       cur_node = cur_node->next, id++)
+  {
+    int num_of_next_nodes = cur_node->data->num_of_next_nodes;
+    if (num_of_next_nodes == 0)
+    {
+      continue;
+    }
+    NextNodeCounter *counter_list = malloc (num_of_next_nodes
+                                            * sizeof (NextNodeCounter));
+    if (counter_list == NULL)
+    {
+      return false;
+    }
+    unpack_counter_list (cur_node->data, counters);
+    for (int i = 0; i < num_of_next_nodes; i++)
+    {
+      counter_list[i].markov_node = copies[find_state_id (
+          state_ids, num_of_states, counters[i].markov_node)];
+      counter_list[i].frequency = counters[i].frequency;
+    }
+    set_counter_list (copies[id], counter_list, num_of_next_nodes);
+  }
+  return true;
+}
+
+MarkovChain* copy_markov_chain (MarkovChain *markov_chain)
+{
+  MarkovChain *copy = malloc (sizeof (MarkovChain));
+  if (copy == NULL)
+  {
+    printf ("%s", ALLOCATION_ERROR_MASSAGE);
+    return NULL;
+  }
+  *copy = *markov_chain;
+  copy->database = calloc (1, sizeof (LinkedList));
+  if (copy->database == NULL)
+  {
+    printf ("%s", ALLOCATION_ERROR_MASSAGE);
+    free (copy);
+    return NULL;
+  }
+  int num_of_states = markov_chain->database->size;
+  int max_next_nodes = 0;
+  for (Node *cur_node = markov_chain->database->first; cur_node != NULL;
+       cur_node = cur_node->next)
+  {
+    if (cur_node->data->num_of_next_nodes > max_next_nodes)
+    {
+      max_next_nodes = cur_node->data->num_of_next_nodes;
+    }
+  }
+  StateId *state_ids = malloc ((num_of_states + 1) * sizeof (StateId));
+  MarkovNode **copies = malloc ((num_of_states + 1) * sizeof (MarkovNode *));
+  NextNodeCounter *counters = malloc ((max_next_nodes + 1)
+                                      * sizeof (NextNodeCounter));
+  bool success = (state_ids != NULL) & (copies != NULL) & (counters != NULL);
+  int id = 0;
+  for (Node *cur_node = markov_chain->database->first;
+       (cur_node != NULL) & success; cur_node = cur_node->next, id++)
+  {
+    copies[id] = append_to_database (copy, cur_node->data->data);
+    success = (copies[id] != NULL);
+    if (success)
+    {
+      copies[id]->frequency = is_block_state (cur_node->data)
+                              ? 1 : cur_node->data->frequency;
+      state_ids[id] = (StateId) {cur_node->data, id};
+    }
+  }
+  if (success)
+  {
+    qsort (state_ids, num_of_states, sizeof (StateId), comp_state_ids);
+    success = copy_counter_lists (markov_chain, copies, state_ids, counters);
+  }
+  free (state_ids);
+  free (copies);
+  free (counters);
+  if (success && (markov_chain->database->first != NULL)
+      && (markov_chain->database->first->data->frequency == PACKED_STATE))
+  {
+    success = compress_markov_chain (copy);
+  }
+  if (!success)
+  {
+    printf ("%s", ALLOCATION_ERROR_MASSAGE);
+    free_markov_chain (&copy);
+    return NULL;
+  }
+  return copy;
+}
+
+/**
+ * This function fills the successor tables of a bounded generator, once its
+ * states are listed, in the order of the counter lists.
+ * @param generator
+ * @param state_ids buffer with a place for every state
+ */
+static void fill_bounded_transitions (BoundedGenerator *generator,
+                                      StateId *state_ids)
+{
+  int num_of_states = generator->num_of_states;
+  for (int id = 0; id < num_of_states; id++)
+  {
+    state_ids[id] = (StateId) {generator->states[id], id};
+  }
+  qsort (state_ids, num_of_states, sizeof (StateId), comp_state_ids);
+  int num_of_transitions = 0;
+  NextNodeCounter counter;
+  for (int id = 0; id < num_of_states; id++)
+  {
+    generator->next_start[id] = num_of_transitions;
+    unsigned int total_frequency;
+    CounterCursor cursor = start_counter_list (generator->states[id],
+                                               &total_frequency);
+    while (read_next_counter (&cursor, &counter))
+    {
+      generator->next_ids[num_of_transitions] =
+          find_state_id (state_ids, num_of_states, counter.markov_node);
+      generator->next_frequency[num_of_transitions] = counter.frequency;
+      num_of_transitions++;
+    }
+  }
+  generator->next_start[num_of_states] = num_of_transitions;
+}
+
+/**
+ * This function builds the reversed successor tables of a bounded generator:
+ * the ids of the states that lead to state id are prev_ids[prev_start[id]]
+ * to prev_ids[prev_start[id + 1] - 1].
+ * @param generator
+ * @param prev_start output, num of states + 1 places
+ * @param prev_ids output, a place for every transition
+ * @param next_free buffer with a place for every state
+ */
+static void reverse_transitions (const BoundedGenerator *generator,
+                                 int *prev_start, int *prev_ids,
+                                 int *next_free)
+{
+  int num_of_states = generator->num_of_states;
+  int num_of_transitions = generator->next_start[num_of_states];
+  memset (prev_start, 0, (num_of_states + 1) * sizeof (int));
+  for (int i = 0; i < num_of_transitions; i++)
+  {
+    prev_start[generator->next_ids[i] + 1]++;
+  }
+  for (int id = 0; id < num_of_states; id++)
+  {
+    prev_start[id + 1] += prev_start[id];
+  }
+  memcpy (next_free, prev_start, num_of_states * sizeof (int));
+  for (int id = 0; id < num_of_states; id++)
+  {
+    for (int i = generator->next_start[id];
+         i < generator->next_start[id + 1]; i++)
+    {
+      prev_ids[next_free[generator->next_ids[i]]++] = id;
+    }
+  }
+}
+
+/**
+ * This function computes the distances of a bounded generator by a breadth
+ * first search from the last states, over the reversed successor tables,
+ * and lists its first states as the search reaches them, that is by
+ * distance.
+ * @param generator
+ * @param prev_start the reversed successor tables, as reverse_transitions
+ * builds them
+ * @param prev_ids
+ * @param queue buffer with a place for every state
+ */
+static void fill_distances (BoundedGenerator *generator, const int *prev_start,
+                            const int *prev_ids, int *queue)
+{
+  int queue_start = 0, queue_end = 0;
+  for (int id = 0; id < generator->num_of_states; id++)
+  {
+    bool is_last = generator->markov_chain->is_last (
+        generator->states[id]->data);
+    generator->distances[id] = is_last ? 0 : -1;
+    if (is_last)
+    {
+      queue[queue_end++] = id;
+    }
+  }
+  while (queue_start < queue_end)
+  {
+    int id = queue[queue_start++];
+    if (generator->distances[id] > 0)
+    {
+      generator->first_ids[generator->num_of_first_ids++] = id;
+    }
+    for (int i = prev_start[id]; i < prev_start[id + 1]; i++)
+    {
+      if (generator->distances[prev_ids[i]] == -1)
+      {
+        generator->distances[prev_ids[i]] = generator->distances[id] + 1;
+        queue[queue_end++] = prev_ids[i];
+      }
+    }
+  }
+}
+
+BoundedGenerator* create_bounded_generator (MarkovChain *markov_chain)
+{
+  BoundedGenerator *generator = calloc (1, sizeof (BoundedGenerator));
+  if (generator == NULL)
+  {
+    printf ("%s", ALLOCATION_ERROR_MASSAGE);
+    return NULL;
+  }
+  int num_of_states = markov_chain->database->size;
+  long int num_of_transitions = 0;
+  for (Node *cur_node = markov_chain->database->first; cur_node != NULL;
+       cur_node = cur_node->next)
+  {
+    num_of_transitions += cur_node->data->num_of_next_nodes;
+  }
+  generator->markov_chain = markov_chain;
+  generator->num_of_states = num_of_states;
+  generator->states = malloc ((num_of_states + 1) * sizeof (MarkovNode *));
+  generator->next_start = malloc ((num_of_states + 1) * sizeof (int));
+  generator->next_ids = malloc ((num_of_transitions + 1) * sizeof (int));
+  generator->next_frequency = malloc ((num_of_transitions + 1) * sizeof (int));
+  generator->distances = malloc ((num_of_states + 1) * sizeof (int));
+  generator->first_ids = malloc ((num_of_states + 1) * sizeof (int));
+  StateId *state_ids = malloc ((num_of_states + 1) * sizeof (StateId));
+  int *prev_start = malloc ((num_of_states + 1) * sizeof (int));
+  int *prev_ids = malloc ((num_of_transitions + 1) * sizeof (int));
+  int *queue = malloc ((num_of_states + 1) * sizeof (int));
+  if ((generator->states == NULL) | (generator->next_start == NULL)
+      | (generator->next_ids == NULL) | (generator->next_frequency == NULL)
+      | (generator->distances == NULL) | (generator->first_ids == NULL)
+      | (state_ids == NULL) | (prev_start == NULL) | (prev_ids == NULL)
+      | (queue == NULL))
+  {
+    printf ("%s", ALLOCATION_ERROR_MASSAGE);
+    free (state_ids);
+    free (prev_start);
+    free (prev_ids);
+    free (queue);
+    free_bounded_generator (&generator);
+    return NULL;
+  }
+  int id = 0;
+  for (Node *cur_node = markov_chain->database->first; cur_node != NULL;
+       cur_node = cur_node->next)
+  {
+    generator->states[id++] = cur_node->data;
+  }
+  fill_bounded_transitions (generator, state_ids);
+  reverse_transitions (generator, prev_start, prev_ids, queue);
+  fill_distances (generator, prev_start, prev_ids, queue);
+  free (state_ids);
+  free (prev_start);
+  free (prev_ids);
+  free (queue);
+  return generator;
+}
+
+void free_bounded_generator (BoundedGenerator **generator)
+{
+  if (*generator == NULL)
+  {
+    return;
+  }
+  free ((*generator)->states);
+  free ((*generator)->next_start);
+  free ((*generator)->next_ids);
+  free ((*generator)->next_frequency);
+  free ((*generator)->distances);
+  free ((*generator)->first_ids);
+  free (*generator);
+  *generator = NULL;
+}
+
+/**
+ * This function checks if a state can reach a last state within a num of
+ * steps.
+ * @param generator
+ * @param id of the state
+ * @param max_distance
+ * @return true if it can, false otherwise.
+ */
+static bool can_end_within (const BoundedGenerator *generator, int id,
+                            int max_distance)
+{
+  return (generator->distances[id] != -1)
+         & (generator->distances[id] <= max_distance);
+}
+
+/**
+ * This function chooses a random first state among those that can end a
+ * sequence in time. They are the first first_ids, as first_ids are sorted by
+ * distance, so they are counted by a binary search.
+ * @param generator
+ * @param max_length maximum length of the sequence
+ * @param seed random state of the caller, NULL to use rand()
+ * @return id of the chosen state, -1 if there is none.
+ */
+static int choose_bounded_first_id (const BoundedGenerator *generator,
+                                    int max_length, unsigned int *seed)
+{
+  int low = 0, high = generator->num_of_first_ids;
+  while (low < high)
+  {
+    int middle = low + (high - low) / 2;
+    if (generator->distances[generator->first_ids[middle]] <= max_length - 1)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+  if (low == 0)
+  {
+    return -1;
+  }
+  return generator->first_ids[get_random_number_r (low, seed)];
+}
+
+/**
+ * This function chooses randomly the next state, among the next states that
+ * can reach a last state within a num of steps.
+ * @param generator
+ * @param id of the state to choose from
+ * @param max_distance
+ * @param seed random state of the caller, NULL to use rand()
+ * @return id of the chosen state, -1 if there is none.
+ */
+static int get_next_bounded_id (const BoundedGenerator *generator, int id,
+                                int max_distance, unsigned int *seed)
+{
+  long int counter = 0;
+  int first = generator->next_start[id], last = generator->next_start[id + 1];
+  for (int i = first; i < last; i++)
+  {
+    if (can_end_within (generator, generator->next_ids[i], max_distance))
+    {
+      counter += generator->next_frequency[i];
+    }
+  }
+  if (counter == 0)
+  {
+    return -1;
+  }
+  int random_num = get_random_number_r ((int) counter, seed);
+  long int cur_iter = 0;
+  for (int i = first; i < last; i++)
+  {
+    if (can_end_within (generator, generator->next_ids[i], max_distance))
+    {
+      cur_iter += generator->next_frequency[i];
+      if (cur_iter > random_num)
+      {
+        return generator->next_ids[i];
+      }
+    }
+  }
+  return -1;
+}
+
+int generate_bounded_sequence_to_array (const BoundedGenerator *generator,
+                                        int max_length, MarkovNode **sequence)
+{
+  return generate_bounded_sequence_to_array_r (generator, max_length,
+                                               sequence, NULL);
+}
+
+int generate_bounded_sequence_to_array_r (const BoundedGenerator *generator,
+                                          int max_length,
+                                          MarkovNode **sequence,
+                                          unsigned int *seed)
+{
+  int id = choose_bounded_first_id (generator, max_length, seed);
+  if (id == -1)
+  {
+    return 0;
+  }
+  int num_of_words = 0;
+  // Every state written can end within the length left, so there is always
+  // a next state that can too, until a last state is reached
+  while (true)
+  {
+    sequence[num_of_words++] = generator->states[id];
+    if (generator->distances[id] == 0)
+    {
+      return num_of_words;
+    }
+    id = get_next_bounded_id (generator, id, max_length - num_of_words - 1,
+                              seed);
+  }
+}
@@ -9,6 +9,11 @@
 #define ALLOCATION_ERROR_MASSAGE "Allocation failure: Failed to allocate new\
  memory\n"
 
+// the frequency of the states of a compressed chain
+#define PACKED_STATE (-1)
+// the frequency of the states appended by append_states_to_database
+#define BLOCK_STATE (-2)
+
 /***************************/
 /*        TYPEDEF          */
 /***************************/
@@ -34,11 +39,18 @@ typedef struct NextNodeCounter {
 
 typedef struct MarkovNode {
     void *data;
+    union {
+        struct NextNodeCounter *counter_list; // unless the chain was compressed
+        // if the chain was compressed: the sum of the frequencies, then
+        // (offset, frequency) varint pairs, see compress_markov_chain
+        unsigned char *packed_list;
+    };
     int num_of_next_nodes;
-    struct NextNodeCounter *counter_list;
+    // number of times the state was added (after decay), or PACKED_STATE or
+    // BLOCK_STATE if the state is allocated in a block with the others
+    int frequency;
 } MarkovNode;
 
-
 /* DO NOT ADD or CHANGE variable names in this struct */
 typedef struct MarkovChain {
     LinkedList *database;
@@ -72,7 +84,56 @@ typedef struct MarkovChain {
 } MarkovChain;
 
 /**
- * Get one random state from the given markov_chain's database.
+ * struct holds the read-only tables used to score sequences against a trained
+ * markov chain. The states are sorted by the chain's comp_func, and the
+ * successors of states[i] are next_ids[next_start[i]..next_start[i + 1]),
+ * sorted by index, with the matching log-probabilities in next_log_prob.
+ */
+typedef struct MarkovScorer {
+    MarkovChain *markov_chain;
+    MarkovNode **states;
+    int num_of_states;
+    int *next_start;
+    int *next_ids;
+    double *next_log_prob; // log(frequency) minus the state's log-normalizer
+} MarkovScorer;
+
+/**
+ * struct holds the read-only tables used to generate sequences that end on a
+ * last state in time. The states are by database order, and the successors
+ * of states[i] are next_ids[next_start[i]..next_start[i + 1]), in the order
+ * of its counter list, with their frequencies in next_frequency.
+ */
+typedef struct BoundedGenerator {
+    MarkovChain *markov_chain;
+    MarkovNode **states;
+    int num_of_states;
+    int *next_start;
+    int *next_ids;
+    int *next_frequency;
+    // min num of steps from each state to a last state, 0 for a last state,
+    // -1 if there is no way to one
+    int *distances;
+    // the states a sequence can start at: those that are not last but can
+    // reach one, sorted by distance
+    int *first_ids;
+    int num_of_first_ids;
+} BoundedGenerator;
+
+/**
+ * struct holds the score of a single sequence
+ */
+typedef struct SequenceScore {
+    double log_prob; // sum of the log-probabilities of the seen transitions
+    double perplexity; // exp(-log_prob / seen transitions)
+    int num_of_transitions; // transitions in the sequence, seen or not
+    int num_of_unseen; // transitions that never occurred in training
+} SequenceScore;
+
+/**
+ * Get one random state from the given markov_chain's database. Last states,
+ * and states without next states (a line's last word, or one whose
+ * transitions were all evicted by decay_markov_chain), are never chosen.
  * @param markov_chain
  * @return
  */
@@ -80,11 +141,24 @@ MarkovNode* get_first_random_node(MarkovChain *markov_chain);
 
 /**
  * Choose randomly the next state, depend on it's occurrence frequency.
+ * The chain of the state may be compressed.
  * @param state_struct_ptr MarkovNode to choose from
  * @return MarkovNode of the chosen state
  */
 MarkovNode* get_next_random_node(MarkovNode *state_struct_ptr);
 
+/**
+ * Choose randomly the next state like get_next_random_node, drawing from the
+ * caller's random state instead of rand(). Threads that each pass their own
+ * seed may sample the same chain at once, as long as it is not modified.
+ * The chain may be compressed.
+ * @param state_struct_ptr MarkovNode to choose from
+ * @param seed random state of the caller, as used by rand_r()
+ * @return MarkovNode of the chosen state
+ */
+MarkovNode* get_next_random_node_r(MarkovNode *state_struct_ptr,
+                                   unsigned int *seed);
+
 /**
  * Receive markov_chain, generate and print random sentence out of it. The
  * sentence most have at least 2 words in it.
@@ -96,6 +170,56 @@ MarkovNode* get_next_random_node(MarkovNode *state_struct_ptr);
 void generate_random_sequence(MarkovChain *markov_chain, MarkovNode *
 first_node, int max_length);
 
+/**
+ * Receive markov_chain, generate a random sequence out of it and write its
+ * states to an array instead of printing them. Samples exactly like
+ * generate_random_sequence.
+ * @param markov_chain
+ * @param first_node markov_node to start with, if NULL- choose a random
+ * markov_node
+ * @param max_length maximum length of chain to generate, at least 2
+ * @param sequence output, array with a place for max_length states
+ * @return num of states written to sequence
+ */
+int generate_random_sequence_to_array(MarkovChain *markov_chain,
+                                      MarkovNode *first_node, int max_length,
+                                      MarkovNode **sequence);
+
+/**
+ * Same as generate_random_sequence_to_array, drawing from the caller's
+ * random state instead of rand(), so threads may generate from the same
+ * chain at once.
+ * @param markov_chain
+ * @param first_node markov_node to start with, if NULL- choose a random
+ * markov_node
+ * @param max_length maximum length of chain to generate, at least 2
+ * @param sequence output, array with a place for max_length states
+ * @param seed random state of the caller, as used by rand_r()
+ * @return num of states written to sequence
+ */
+int generate_random_sequence_to_array_r(MarkovChain *markov_chain,
+                                        MarkovNode *first_node,
+                                        int max_length, MarkovNode **sequence,
+                                        unsigned int *seed);
+
+/**
+ * Generate num_of_sequences random sequences into a single array, one after
+ * the other, as generate_random_sequence_to_array does. Sequence i starts at
+ * sequences[i * max_length], and its length is written to lengths[i].
+ * @param markov_chain
+ * @param first_node markov_node to start every sequence with, if NULL-
+ * choose a random markov_node for each sequence
+ * @param max_length maximum length of each sequence, at least 2
+ * @param num_of_sequences num of sequences to generate
+ * @param sequences output, array with a place for num_of_sequences *
+ * max_length states
+ * @param lengths output, array with a place for num_of_sequences lengths
+ */
+void generate_random_sequences(MarkovChain *markov_chain,
+                               MarkovNode *first_node, int max_length,
+                               int num_of_sequences, MarkovNode **sequences,
+                               int *lengths);
+
 /**
  * Free markov_chain and all of it's content from memory
  * @param markov_chain markov_chain to free
@@ -109,7 +233,7 @@ void free_markov_chain(MarkovChain **markov_chain);
  * @param second_node
  * @param markov_chain
  * @return success/failure: true if the process was successful, false if in
- * case of allocation error.
+ * case of allocation error or if the chain is compressed.
  */
 bool add_node_to_counter_list(MarkovNode *first_node, MarkovNode
 *second_node, MarkovChain *markov_chain);
@@ -133,4 +257,180 @@ Node* get_node_from_database(MarkovChain *markov_chain, void *data_ptr);
  */
 Node* add_to_database(MarkovChain *markov_chain, void *data_ptr);
 
+/**
+ * Create new markov_node wrapping data_ptr and add it to the end of
+ * markov_chain's database, without looking for it in the database first.
+ * Use it only for states known not to be in the database.
+ * @param markov_chain the chain to add to
+ * @param data_ptr the state to add
+ * @return the new markov_node, NULL in case of allocation failure.
+ */
+MarkovNode* append_to_database(MarkovChain *markov_chain, void *data_ptr);
+
+/**
+ * Fill an empty database with num_of_states states at once. The states,
+ * their list nodes and their counter lists are allocated as a single block,
+ * freed with the chain, instead of one at a time. State i wraps a copy of
+ * data + i * data_size made by copy_func, and its counter_list has a place
+ * for num_of_next_nodes[i] counters, for the caller to fill. The chain can't
+ * be trained or decayed afterwards.
+ * @param markov_chain the chain to fill, with an empty database
+ * @param data array of num_of_states states
+ * @param data_size size of a single state in data
+ * @param num_of_states
+ * @param num_of_next_nodes num of next nodes of each state
+ * @return the new states, by index, NULL in case of allocation failure or if
+ * the database is not empty.
+ */
+MarkovNode* append_states_to_database(MarkovChain *markov_chain,
+                                      const void *data, size_t data_size,
+                                      int num_of_states,
+                                      const int *num_of_next_nodes);
+
+/**
+ * Replace the counter list of markov_node with the given one. Cheaper than
+ * adding the next nodes one by one with add_node_to_counter_list when they
+ * are all known up front. The chain of markov_node must not be compressed,
+ * and markov_node must not be appended by append_states_to_database.
+ * @param markov_node the node to set the counter list of
+ * @param counter_list dynamically allocated list of distinct next nodes,
+ * owned by markov_node afterwards
+ * @param num_of_next_nodes num of entries in counter_list
+ */
+void set_counter_list(MarkovNode *markov_node, NextNodeCounter *counter_list,
+                      int num_of_next_nodes);
+
+/**
+ * Scale down the frequency of every state and transition in markov_chain by
+ * decay_factor, and evict the ones that drop below min_frequency. Evicted
+ * transitions are removed from their counter list, evicted states are removed
+ * from the database and from every counter list pointing to them, and their
+ * memory is freed. Each call costs one pass over the states and transitions.
+ * A surviving state may be left without next states, and is then not chosen
+ * as a first state anymore.
+ * A compressed chain, or one filled by append_states_to_database, is not
+ * decayed.
+ * @param markov_chain the chain to decay
+ * @param decay_factor factor in (0, 1] to multiply every frequency by
+ * @param min_frequency lowest frequency a state or a transition may keep.
+ * Values below 1 are taken as 1, so a frequency that drops to 0 is always
+ * evicted and sampling never meets a transition of zero weight.
+ * @return number of evicted states
+ */
+int decay_markov_chain(MarkovChain *markov_chain, double decay_factor,
+                       int min_frequency);
+
+/**
+ * Build the scoring tables of a trained markov_chain. The chain is not
+ * modified, and must not be modified while the scorer is in use.
+ * @param markov_chain the chain to score against
+ * @return pointer to MarkovScorer, NULL in case of allocation failure.
+ */
+MarkovScorer* create_markov_scorer(MarkovChain *markov_chain);
+
+/**
+ * Score a sequence of states against the scorer's chain. Like in training, no
+ * transition is counted out of a last state. The function only reads the
+ * scorer, so it may be called from several threads at once.
+ * @param scorer tables built by create_markov_scorer
+ * @param sequence the states to score, compared with the chain's comp_func
+ * @param length num of states in sequence
+ * @return the score of the sequence
+ */
+SequenceScore score_sequence(const MarkovScorer *scorer, void **sequence,
+                             int length);
+
+/**
+ * Free markov_scorer and all of it's content from memory
+ * @param scorer scorer to free
+ */
+void free_markov_scorer(MarkovScorer **scorer);
+
+/**
+ * Compress markov_chain: its states, their list nodes and their counter lists
+ * are moved into a single allocation, so none of them pays a per-allocation
+ * overhead, and pointers to its states taken before are invalid afterwards.
+ * The states are placed by database order, and each counter list is stored
+ * as the sum of its frequencies, followed by its next nodes' places relative
+ * to the state, sorted and delta-encoded, each with its frequency, all as
+ * varints. This takes 2-4 bytes per next node instead of
+ * sizeof (NextNodeCounter). The chain can still be sampled, scored and
+ * generated from, but can't be trained or decayed anymore, and the frequency
+ * of its states is not kept. Sampling draws the same random numbers, but
+ * walks the next nodes in database order. The data of the states is not
+ * moved.
+ * @param markov_chain the trained chain to compress
+ * @return true on success, false in case of allocation failure, in which
+ * case the chain is left unchanged.
+ */
+bool compress_markov_chain(MarkovChain *markov_chain);
+
+/**
+ * Write the counter list of markov_node into an array, whether it is
+ * compressed or not.
+ * @param markov_node
+ * @param counter_list output, array with a place for num_of_next_nodes
+ * entries
+ */
+void unpack_counter_list(MarkovNode *markov_node,
+                         NextNodeCounter *counter_list);
+
+/**
+ * Create a deep copy of markov_chain: its states are copied with copy_func,
+ * and its counter lists are copied and pointed at the new states. A
+ * compressed chain gives a compressed copy. The copy's memory is allocated
+ * by the calling thread.
+ * @param markov_chain the chain to copy, not modified
+ * @return pointer to the new MarkovChain, NULL in case of allocation failure.
+ */
+MarkovChain* copy_markov_chain(MarkovChain *markov_chain);
+
+/**
+ * Build the tables to generate bounded sequences from a trained markov_chain.
+ * The distance of every state to a last state is found by a breadth first
+ * search from the last states, over the reversed counter lists. The chain is
+ * not modified, and the tables must be built again once it is.
+ * @param markov_chain the chain to generate from, compressed or not
+ * @return pointer to BoundedGenerator, NULL in case of allocation failure.
+ */
+BoundedGenerator* create_bounded_generator(MarkovChain *markov_chain);
+
+/**
+ * Free a bounded generator and all of it's content from memory
+ * @param generator generator to free
+ */
+void free_bounded_generator(BoundedGenerator **generator);
+
+/**
+ * Generate a random sequence into an array, as
+ * generate_random_sequence_to_array does, that always ends on a last state
+ * within max_length states. The first state is chosen among those that are
+ * not last and can end in time, and each step samples only the next states
+ * that can still reach a last state in the length left, by their
+ * frequencies, so no sequence is cut short.
+ * @param generator tables built by create_bounded_generator
+ * @param max_length maximum length of chain to generate, at least 2
+ * @param sequence output, array with a place for max_length states
+ * @return num of states written to sequence, 0 if no state can start a
+ * sequence that ends within max_length states.
+ */
+int generate_bounded_sequence_to_array(const BoundedGenerator *generator,
+                                       int max_length, MarkovNode **sequence);
+
+/**
+ * Same as generate_bounded_sequence_to_array, drawing from the caller's
+ * random state instead of rand(). The function only reads the generator, so
+ * threads may generate from it at once.
+ * @param generator tables built by create_bounded_generator
+ * @param max_length maximum length of chain to generate, at least 2
+ * @param sequence output, array with a place for max_length states
+ * @param seed random state of the caller, as used by rand_r()
+ * @return num of states written to sequence, 0 if no sequence can end in
+ * time.
+ */
+int generate_bounded_sequence_to_array_r(const BoundedGenerator *generator,
+                                         int max_length,
+                                         MarkovNode **sequence,
+                                         unsigned int *seed);
+
 #endif /* markov_chain_h */
@@ -0,0 +1,182 @@
+#define _GNU_SOURCE // For sched_setaffinity(), CPU_SET()
+#include "numa_replica.h"
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#define NODE_CPULIST_FORMAT "/sys/devices/system/node/node%d/cpulist"
+#define MAX_PATH_LEN 64
+#define MAX_CPULIST_LEN 4096
+#define CPU_RANGE_SEPARATOR '-'
+#define CPU_LIST_SEPARATOR ','
+#define BASE 10
+
+/**
+ * This function reads the CPUs of a NUMA node, listed in sysfs as ranges
+ * such as "0-3,8-11".
+ * @param numa_node id of the node
+ * @param cpus output, the CPUs of the node
+ * @return num of CPUs of the node, -1 if the node does not exist.
+ */
+static int read_node_cpus (int numa_node, cpu_set_t *cpus)
+{
+  char path[MAX_PATH_LEN];
+  snprintf (path, MAX_PATH_LEN, NODE_CPULIST_FORMAT, numa_node);
+  FILE *fp = fopen (path, "r");
+  if (fp == NULL)
+  {
+    return -1;
+  }
+  char cpulist[MAX_CPULIST_LEN];
+  if (fgets (cpulist, MAX_CPULIST_LEN, fp) == NULL)
+  {
+    cpulist[0] = '\0';
+  }
+  fclose (fp);
+  CPU_ZERO (cpus);
+  char *cur = cpulist;
+  while ((*cur >= '0') && (*cur <= '9'))
+  {
+    long int first = strtol (cur, &cur, BASE), last = first;
+    if (*cur == CPU_RANGE_SEPARATOR)
+    {
+      last = strtol (cur + 1, &cur, BASE);
+    }
+    for (long int cpu = first; (cpu <= last) && (cpu < CPU_SETSIZE); cpu++)
+    {
+      CPU_SET (cpu, cpus);
+    }
+    if (*cur == CPU_LIST_SEPARATOR)
+    {
+      cur++;
+    }
+  }
+  return CPU_COUNT (cpus);
+}
+
+int get_numa_nodes (int nodes[MAX_NUMA_NODES])
+{
+  int num_of_nodes = 0;
+  cpu_set_t cpus;
+  int num_of_cpus;
+  for (int node = 0; (num_of_nodes < MAX_NUMA_NODES)
+                     && ((num_of_cpus = read_node_cpus (node, &cpus)) != -1);
+       node++)
+  {
+    if (num_of_cpus > 0)
+    {
+      nodes[num_of_nodes] = node;
+      num_of_nodes++;
+    }
+  }
+  if (num_of_nodes == 0)
+  {
+    nodes[0] = 0;
+    num_of_nodes = 1;
+  }
+  return num_of_nodes;
+}
+
+bool bind_to_numa_node (int numa_node)
+{
+  cpu_set_t cpus;
+  if (read_node_cpus (numa_node, &cpus) <= 0)
+  {
+    return false;
+  }
+  return sched_setaffinity (0, sizeof (cpu_set_t), &cpus) == 0;
+}
+
+/**
+ * struct holds a replica to fill, and how
+ */
+typedef struct ReplicaTask {
+    ChainReplica *replica;
+    bool compress; // whether to compress the replica's chain
+    bool bounded; // whether to build the replica's bounded generator
+} ReplicaTask;
+
+/**
+ * This function fills a replica on the calling thread's node. It runs as a
+ * thread.
+ * @param arg pointer to the ReplicaTask to work on. Its replica's
+ * markov_chain is the chain to copy, and its numa_node is the node to bind
+ * to.
+ * @return NULL. The replica's markov_chain is NULL in case of failure.
+ */
+static void *fill_replica (void *arg)
+{
+  ReplicaTask *task = arg;
+  ChainReplica *replica = task->replica;
+  if (replica->numa_node != NO_NUMA_NODE)
+  {
+    bind_to_numa_node (replica->numa_node);
+  }
+  MarkovChain *copy = copy_markov_chain (replica->markov_chain);
+  replica->markov_chain = copy;
+  if (copy == NULL)
+  {
+    return NULL;
+  }
+  // compressing moves the states, so they are listed after it
+  if (task->compress && !compress_markov_chain (copy))
+  {
+    free_chain_replica (replica);
+    return NULL;
+  }
+  replica->first_states = malloc ((copy->database->size + 1)
+                                  * sizeof (MarkovNode *));
+  if (replica->first_states == NULL)
+  {
+    printf ("%s", ALLOCATION_ERROR_MASSAGE);
+    free_markov_chain (&replica->markov_chain);
+    replica->markov_chain = NULL;
+    return NULL;
+  }
+  for (Node *cur_node = copy->database->first; cur_node != NULL;
+       cur_node = cur_node->next)
+  {
+    MarkovNode *state = cur_node->data;
+    if (!copy->is_last (state->data) && (state->num_of_next_nodes > 0))
+    {
+      replica->first_states[replica->num_of_first_states++] = state;
+    }
+  }
+  if (task->bounded
+      && ((replica->generator = create_bounded_generator (copy)) == NULL))
+  {
+    free_chain_replica (replica);
+  }
+  return NULL;
+}
+
+bool create_chain_replica (MarkovChain *markov_chain, int numa_node,
+                           bool compress, bool bounded,
+                           ChainReplica *replica)
+{
+  *replica = (ChainReplica) {markov_chain, NULL, 0, numa_node, NULL};
+  ReplicaTask task = {replica, compress, bounded};
+  pthread_t thread;
+  if ((numa_node != NO_NUMA_NODE)
+      && (pthread_create (&thread, NULL, fill_replica, &task) == 0))
+  {
+    pthread_join (thread, NULL);
+  }
+  else
+  {
+    fill_replica (&task);
+  }
+  return replica->markov_chain != NULL;
+}
+
+void free_chain_replica (ChainReplica *replica)
+{
+  if (replica->markov_chain != NULL)
+  {
+    free_markov_chain (&replica->markov_chain);
+    replica->markov_chain = NULL;
+  }
+  free (replica->first_states);
+  replica->first_states = NULL;
+  free_bounded_generator (&replica->generator);
+}
@@ -0,0 +1,61 @@
+#ifndef _NUMA_REPLICA_H_
+#define _NUMA_REPLICA_H_
+#include "markov_chain.h"
+
+#define MAX_NUMA_NODES 64
+#define NO_NUMA_NODE (-1)
+
+/**
+ * struct holds a read-only copy of a trained chain whose memory is local to a
+ * single NUMA node
+ */
+typedef struct ChainReplica {
+    MarkovChain *markov_chain;
+    MarkovNode **first_states; // the states a sequence may start from
+    int num_of_first_states;
+    int numa_node;
+    BoundedGenerator *generator; // of the replica's chain, or NULL
+} ChainReplica;
+
+/**
+ * Find the NUMA nodes of the machine that have CPUs. A machine without NUMA
+ * information is reported as the single node 0.
+ * @param nodes output, the ids of the nodes
+ * @return num of nodes written to nodes, at least 1.
+ */
+int get_numa_nodes(int nodes[MAX_NUMA_NODES]);
+
+/**
+ * Pin the calling thread to the CPUs of a NUMA node, so the memory it
+ * touches first is allocated on that node.
+ * @param numa_node id of the node
+ * @return true on success, false if the node's CPUs can't be found or used.
+ */
+bool bind_to_numa_node(int numa_node);
+
+/**
+ * Copy markov_chain from a thread pinned to a NUMA node, so the copy's states
+ * and counter lists are allocated on that node. The states a sequence may
+ * start from, as get_first_random_node chooses them, are listed once, so a
+ * first state is drawn in constant time.
+ * @param markov_chain the trained chain to copy, not modified
+ * @param numa_node id of the node to place the replica on, or NO_NUMA_NODE
+ * to copy it on the calling thread, wherever it runs
+ * @param compress whether to compress the replica's chain, before its
+ * states are listed
+ * @param bounded whether to build the replica's bounded generator too, on
+ * the same node
+ * @param replica output, the new replica
+ * @return true on success, false in case of allocation failure.
+ */
+bool create_chain_replica(MarkovChain *markov_chain, int numa_node,
+                          bool compress, bool bounded,
+                          ChainReplica *replica);
+
+/**
+ * Free a replica and all of it's content from memory
+ * @param replica replica to free
+ */
+void free_chain_replica(ChainReplica *replica);
+
+#endif //_NUMA_REPLICA_H_
@@ -0,0 +1,307 @@
+#define _POSIX_C_SOURCE 200809L // For clock_gettime(), getpid()
+#include "phase_trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#ifdef __GLIBC__
+#include <malloc.h> // For mallinfo2()
+#endif
+
+#define MAX_PHASE_DEPTH 32
+#define STATM_PATH "/proc/self/statm"
+#define STATM_FORMAT "%*s %ld"
+#define STATM_LEN 128
+#define MICROS_IN_SECOND 1e6
+#define MICROS_IN_NANO 1e-3
+#define MILLIS_IN_MICRO 1e-3
+#define BYTES_IN_KB 1024
+#define TRACE_HEADER "{\"traceEvents\":[\n"
+#define TRACE_FOOTER "\n],\"displayTimeUnit\":\"ms\"}\n"
+#define EVENT_SEPARATOR ",\n"
+#define PHASE_EVENT_FORMAT "{\"name\":\"%s\",\"cat\":\"phase\",\"ph\":\"X\",\
+\"pid\":%ld,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"cpu_ms\":%.3f,\
+\"allocations\":%ld,\"frees\":%ld,\"heap_kb\":%ld,\"heap_delta_kb\":%ld,\
+\"rss_kb\":%ld,\"peak_rss_kb\":%ld}}"
+#define COUNTER_EVENT_FORMAT "{\"name\":\"%s\",\"ph\":\"C\",\"pid\":%ld,\
+\"tid\":1,\"ts\":%.3f,\"args\":{\"%s\":%ld}}"
+#define RSS_COUNTER "rss_kb"
+#define HEAP_COUNTER "heap_kb"
+#define LIVE_ALLOCATIONS_COUNTER "live_allocations"
+
+/***************************/
+/*        STRUCTS          */
+/***************************/
+
+/**
+ * struct holds the measures taken when a phase begins
+ */
+typedef struct TraceSnapshot {
+    const char *name;
+    double wall_us; // wall time since the trace started
+    double cpu_ms; // CPU time of the process, all threads
+    long int heap_kb;
+    long int allocations;
+    long int frees;
+} TraceSnapshot;
+
+/***************************/
+
+static FILE *trace_file = NULL;
+static struct timespec trace_start_time;
+static long int trace_pid;
+static TraceSnapshot phases[MAX_PHASE_DEPTH];
+static int num_of_phases = 0;
+static long int num_of_allocations = 0;
+static long int num_of_frees = 0;
+
+/* The programs are linked with --wrap for the allocation functions (see the
+ * makefile), so the calls of their own code, and only those, come through
+ * here: the allocator itself, the C library and the other libraries are left
+ * alone. Calls are counted only while a trace is open. The real functions are
+ * weak, so a program linked without --wrap still links, and counts nothing. */
+
+__attribute__ ((weak)) void *__real_malloc (size_t size);
+__attribute__ ((weak)) void *__real_calloc (size_t num, size_t size);
+__attribute__ ((weak)) void *__real_realloc (void *ptr, size_t size);
+__attribute__ ((weak)) void *__real_aligned_alloc (size_t alignment,
+                                                    size_t size);
+__attribute__ ((weak)) void __real_free (void *ptr);
+
+/**
+ * This function counts a single allocation or free, if tracing.
+ * @param counter the counter to increment
+ */
+static void count_allocation_call (long int *counter)
+{
+  if (__atomic_load_n (&trace_file, __ATOMIC_RELAXED) != NULL)
+  {
+    __atomic_add_fetch (counter, 1, __ATOMIC_RELAXED);
+  }
+}
+
+void *__wrap_malloc (size_t size)
+{
+  count_allocation_call (&num_of_allocations);
+  return __real_malloc (size);
+}
+
+void *__wrap_calloc (size_t num, size_t size)
+{
+  count_allocation_call (&num_of_allocations);
+  return __real_calloc (num, size);
+}
+
+void *__wrap_realloc (void *ptr, size_t size)
+{
+  if (ptr == NULL)
+  {
+    count_allocation_call (&num_of_allocations);
+  }
+  return __real_realloc (ptr, size);
+}
+
+void *__wrap_aligned_alloc (size_t alignment, size_t size)
+{
+  count_allocation_call (&num_of_allocations);
+  return __real_aligned_alloc (alignment, size);
+}
+
+void __wrap_free (void *ptr)
+{
+  if (ptr != NULL)
+  {
+    count_allocation_call (&num_of_frees);
+  }
+  __real_free (ptr);
+}
+
+/**
+ * This function measures the heap memory the process is using, as the
+ * allocator reports it: bytes in allocated chunks, and in chunks mapped on
+ * their own with mmap.
+ * @return heap memory in use in KB, 0 if the allocator doesn't report it.
+ */
+static long int get_heap_kb (void)
+{
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || (__GLIBC_MINOR__ >= 33))
+  struct mallinfo2 info = mallinfo2 ();
+  return (long int) ((info.uordblks + info.hblkhd) / BYTES_IN_KB);
+#else
+  return 0;
+#endif
+}
+
+/**
+ * This function measures the wall time since the trace started.
+ * @return wall time in microseconds.
+ */
+static double get_wall_us (void)
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - trace_start_time.tv_sec) * MICROS_IN_SECOND
+         + (now.tv_nsec - trace_start_time.tv_nsec) * MICROS_IN_NANO;
+}
+
+/**
+ * This function measures the CPU time of the process, in all of its threads.
+ * @return CPU time in milliseconds.
+ */
+static double get_cpu_ms (void)
+{
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+  return ((usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * MICROS_IN_SECOND
+          + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec)
+         * MILLIS_IN_MICRO;
+}
+
+/**
+ * This function measures the resident memory of the process. It reads the
+ * statm file without stdio, so the measure itself allocates nothing.
+ * @return resident memory in KB, 0 if it can't be read.
+ */
+static long int get_rss_kb (void)
+{
+  int statm = open (STATM_PATH, O_RDONLY);
+  if (statm == -1)
+  {
+    return 0;
+  }
+  char buffer[STATM_LEN];
+  ssize_t len = read (statm, buffer, STATM_LEN - 1);
+  close (statm);
+  long int pages = 0;
+  if (len > 0)
+  {
+    buffer[len] = '\0';
+    if (sscanf (buffer, STATM_FORMAT, &pages) != 1)
+    {
+      pages = 0;
+    }
+  }
+  return pages * (sysconf (_SC_PAGESIZE) / BYTES_IN_KB);
+}
+
+/**
+ * This function measures the peak resident memory of the process.
+ * @return peak resident memory in KB.
+ */
+static long int get_peak_rss_kb (void)
+{
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+/**
+ * This function writes a single counter event to the trace file.
+ * @param name name of the counter
+ * @param wall_us time of the sample
+ * @param value value of the counter
+ */
+static void write_counter (const char *name, double wall_us, long int value)
+{
+  fprintf (trace_file, "%s" COUNTER_EVENT_FORMAT, EVENT_SEPARATOR, name,
+           trace_pid, wall_us, name, value);
+}
+
+/**
+ * This function writes the resident memory, heap memory and live
+ * allocations counters.
+ * @param wall_us time of the sample
+ */
+static void write_memory_counters (double wall_us)
+{
+  write_counter (RSS_COUNTER, wall_us, get_rss_kb ());
+  write_counter (HEAP_COUNTER, wall_us, get_heap_kb ());
+  write_counter (LIVE_ALLOCATIONS_COUNTER, wall_us,
+                 __atomic_load_n (&num_of_allocations, __ATOMIC_RELAXED)
+                 - __atomic_load_n (&num_of_frees, __ATOMIC_RELAXED));
+}
+
+bool trace_start (const char *path)
+{
+  trace_file = fopen (path, "w");
+  if (trace_file == NULL)
+  {
+    return false;
+  }
+  clock_gettime (CLOCK_MONOTONIC, &trace_start_time);
+  trace_pid = (long int) getpid ();
+  num_of_phases = 0;
+  fprintf (trace_file, TRACE_HEADER);
+  fprintf (trace_file, COUNTER_EVENT_FORMAT, RSS_COUNTER, trace_pid, 0.0,
+           RSS_COUNTER, get_rss_kb ());
+  return true;
+}
+
+void trace_begin (const char *name)
+{
+  if ((trace_file == NULL) || (num_of_phases == MAX_PHASE_DEPTH))
+  {
+    return;
+  }
+  TraceSnapshot *phase = &phases[num_of_phases];
+  phase->name = name;
+  phase->wall_us = get_wall_us ();
+  phase->cpu_ms = get_cpu_ms ();
+  phase->heap_kb = get_heap_kb ();
+  phase->allocations = __atomic_load_n (&num_of_allocations,
+                                        __ATOMIC_RELAXED);
+  phase->frees = __atomic_load_n (&num_of_frees, __ATOMIC_RELAXED);
+  num_of_phases++;
+  write_memory_counters (phase->wall_us);
+}
+
+void trace_end (void)
+{
+  if ((trace_file == NULL) || (num_of_phases == 0))
+  {
+    return;
+  }
+  num_of_phases--;
+  TraceSnapshot *phase = &phases[num_of_phases];
+  double wall_us = get_wall_us ();
+  long int heap_kb = get_heap_kb ();
+  fprintf (trace_file, "%s" PHASE_EVENT_FORMAT, EVENT_SEPARATOR, phase->name,
+           trace_pid, phase->wall_us, wall_us - phase->wall_us,
+           get_cpu_ms () - phase->cpu_ms,
+           __atomic_load_n (&num_of_allocations, __ATOMIC_RELAXED)
+           - phase->allocations,
+           __atomic_load_n (&num_of_frees, __ATOMIC_RELAXED) - phase->frees,
+           heap_kb, heap_kb - phase->heap_kb,
+           get_rss_kb (), get_peak_rss_kb ());
+  write_memory_counters (wall_us);
+}
+
+void trace_counter (const char *name, long int value)
+{
+  if (trace_file == NULL)
+  {
+    return;
+  }
+  double wall_us = get_wall_us ();
+  write_counter (name, wall_us, value);
+  write_memory_counters (wall_us);
+}
+
+bool trace_finish (void)
+{
+  if (trace_file == NULL)
+  {
+    return true;
+  }
+  while (num_of_phases > 0)
+  {
+    trace_end ();
+  }
+  fprintf (trace_file, TRACE_FOOTER);
+  bool success = (ferror (trace_file) == 0);
+  FILE *closed_file = trace_file;
+  __atomic_store_n (&trace_file, NULL, __ATOMIC_RELAXED);
+  return (fclose (closed_file) == 0) & success;
+}
@@ -0,0 +1,51 @@
+#ifndef _PHASE_TRACE_H_
+#define _PHASE_TRACE_H_
+#include <stdbool.h> // for bool
+
+/**
+ * Phase tracing: records the wall time, CPU time, allocations, heap and
+ * resident memory of the phases of a run, and writes them as a Chrome
+ * trace-event JSON file (chrome://tracing, Perfetto). Phases may be nested.
+ * Until trace_start is called, and after trace_finish, every call is a
+ * no-op. Phases and counters are recorded from a single thread.
+ * Allocations are counted only in programs linked with
+ * -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=aligned_alloc,
+ * --wrap=free, and only those made by the program's own code. Heap memory is
+ * 0 where the C library doesn't report it.
+ */
+
+/**
+ * Start tracing into the given file.
+ * @param path the trace file to write
+ * @return true on success, false if the file can't be opened.
+ */
+bool trace_start(const char *path);
+
+/**
+ * Begin a phase. Every call must be matched by a call to trace_end.
+ * @param name name of the phase, must stay valid until the phase ends
+ */
+void trace_begin(const char *name);
+
+/**
+ * End the innermost phase, and record its wall and CPU time, the allocations
+ * and frees done during it, the heap memory when it ends and how much it
+ * grew during it, and the resident memory.
+ */
+void trace_end(void);
+
+/**
+ * Record a sample of a counter, together with the current resident memory,
+ * heap memory and num of live allocations.
+ * @param name name of the counter
+ * @param value value of the counter
+ */
+void trace_counter(const char *name, long int value);
+
+/**
+ * End any phase left open, write the end of the trace file and close it.
+ * @return true on success, false if writing the file failed.
+ */
+bool trace_finish(void);
+
+#endif //_PHASE_TRACE_H_
@@ -1,5 +1,10 @@
+#define _POSIX_C_SOURCE 200809L // For rand_r(), sysconf()
 #include <string.h> // For strlen(), strcmp(), strcpy()
+#include <math.h> // For fabs()
+#include <pthread.h>
+#include <unistd.h>
 #include "markov_chain.h"
+#include "phase_trace.h"
 
 
 /***************************/
@@ -7,6 +12,7 @@
 /***************************/
 
 #define MAX(X, Y) (((X) < (Y)) ? (Y) : (X))
+#define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))
 #define EMPTY -1
 #define BOARD_SIZE 100
 #define MAX_GENERATION_LENGTH 60
@@ -14,12 +20,39 @@
 #define LINE_BREAK "\n"
 #define DICE_MAX 6
 #define NUM_OF_TRANSITIONS 20
-#define NUM_OF_ARGC_ERROR_SNL "Usage: The program receives 2 arguments only.\n"
+#define NUM_OF_ARGC_ERROR_SNL "Usage: The program receives 2 or 3 arguments \
+only.\n"
+#define BOARD_FILE_ERROR "Error: The given board file is invalid.\n"
+#define BOARD_HEADER_FORMAT "%d %d"
+#define TRANSITION_FORMAT "%d %d"
 #define RANDOM_WALK "Random Walk"
 #define ARROW "->"
 #define LADDER_TO "-ladder to"
 #define SNAKE_TO "-snake to"
 #define THREE_ARGS 3
+#define FOUR_ARGS 4
+#define OPTION_PREFIX "--"
+#define SEARCH_OPTION "--search="
+#define SEARCH_OPTION_FORMAT "--search=%d,%d,%lf"
+#define THREADS_OPTION "--threads="
+#define THREADS_OPTION_FORMAT "--threads=%d"
+#define TRACE_OPTION "--trace="
+#define TRACE_ERROR "Error: The given trace file can't be written.\n"
+#define LOAD_BOARD_PHASE "load_board"
+#define SEARCH_PHASE "search"
+#define FILL_DATABASE_PHASE "fill_database"
+#define GENERATE_PHASE "generate"
+#define FREE_PHASE "free_markov_chain"
+#define OPTION_ERROR "Usage: Unknown or invalid option %s\n"
+#define SEARCH_ERROR "Usage: A board of %d cells fits at most %d transitions.\n"
+#define SEARCH_TOP 10
+#define MAX_SWEEPS 100000
+#define CONVERGENCE_EPSILON 1e-9
+#define CANDIDATE_SEED_STEP 2654435761u
+#define PRINT_BOARD "Board"
+#define BOARD_SCORE_FORMAT "%s %d: expected length %.3f, variance %.3f, \
+transitions:"
+#define PRINT_TRANSITION " %d->%d"
 
 /***************************/
 
@@ -39,6 +72,54 @@ typedef struct Cell {
     //both ladder_to and snake_to should be -1 if the Cell doesn't have them
 } Cell;
 
+/**
+ * struct represents the game board, with all of its cells in one array
+ */
+typedef struct Board {
+    Cell *cells; // cells[i] is the cell number i + 1
+    int size; // num of cells in the board
+    int dice_max; // num of faces of the die
+} Board;
+
+/**
+ * struct holds the optional modes the program was asked to run with
+ */
+typedef struct SnakesOptions {
+    int num_of_candidates; // boards to evaluate, 0 if not searching
+    int num_of_transitions; // ladders and snakes in each candidate board
+    double target_length; // expected game length to search for
+    int num_of_threads; // num of threads to evaluate the candidates with
+    const char *trace_path; // file to write the phase trace to, or NULL
+} SnakesOptions;
+
+/**
+ * struct holds the expected game length of a single candidate board
+ */
+typedef struct BoardScore {
+    int candidate; // index of the candidate board, -1 if not evaluated
+    double expected_length;
+    double variance;
+} BoardScore;
+
+/**
+ * struct holds the buffers of a single search thread, allocated once and
+ * reused for every candidate board the thread evaluates
+ */
+typedef struct SearchWorker {
+    const Board *base_board; // size and die of every candidate
+    const SnakesOptions *options;
+    unsigned int seed;
+    int first_candidate;
+    int last_candidate;
+    Board board; // the candidate board being evaluated
+    int (*board_transitions)[2]; // the transitions of the candidate board
+    double *expected; // expected num of steps from each cell to the last
+    double *second_moment; // expected square num of steps to the last cell
+    bool *reachable; // whether a walk from the first cell may visit a cell
+    bool *can_finish; // whether the last cell can be reached from a cell
+    BoardScore top[SEARCH_TOP]; // closest boards found, closest first
+} SearchWorker;
+
 /***************************/
 
 /**
@@ -66,6 +147,11 @@ const int transitions[][2] = {{13, 4},
                               {15, 47},
                               {61, 14}};
 
+/**
+ * size of the board the chain is built from, the last cell of the game
+ */
+static int board_size = BOARD_SIZE;
+
 /**
  * This functions print the data of a cell type object.
  * @param data pointer to cell type object.
@@ -74,7 +160,7 @@ static void cell_print_func (void *data)
 {
   Cell *cell = (Cell*) data;
   printf ("[%d]", cell->number);
-  if (cell->number == BOARD_SIZE)
+  if (cell->number == board_size)
   {
     return;
   }
@@ -115,36 +201,25 @@ static int cell_comp_func (const void *data_1, const void *data_2)
 }
 
 /**
- * This function free a the data of cell type object.
+ * This function does not free a cell of the board, as it is freed with the
+ * board.
  * @param data pointer to cell type object.
  */
-static void cell_free_data (void *data)
+static void cell_keep_data (void *data)
 {
-  if (data == NULL)
-  {
-    return;
-  }
-  free (data);
+  (void) data;
 }
 
 /**
- * This function allocate new cell type object copies the data of the
- * given pointer pointer to the new cell type object.
- * @param data
- * @return pointer to the copied cell type object.
+ * This function keeps the data of a cell of the board, so the chain
+ * references the board's cells instead of copying them. The board must
+ * outlive the chain.
+ * @param data pointer to cell type object.
+ * @return the same pointer.
  */
-static void* cell_copy_func (void const *data)
+static void* cell_share_data (void const *data)
 {
-  Cell *copy_cell = malloc (sizeof (Cell));
-  if (copy_cell == NULL)
-  {
-    return NULL;
-  }
-  Cell *org_cell = (Cell*) data;
-  copy_cell->number = org_cell->number;
-  copy_cell->snake_to = org_cell->snake_to;
-  copy_cell->ladder_to = org_cell->ladder_to;
-  return copy_cell;
+  return (void *) data;
 }
 
 /**
@@ -155,7 +230,7 @@ static void* cell_copy_func (void const *data)
 static bool cell_is_last (void *data)
 {
   Cell *cur_cell = (Cell*) data;
-  return (cur_cell->number == BOARD_SIZE);
+  return (cur_cell->number == board_size);
 }
 
 /**
@@ -170,6 +245,62 @@ static long int convert_char_to_int (char *num_in_char)
   return num_in_int;
 }
 
+/**
+ * This function parses a single option of the form --name=value.
+ * @param option the option the user entered.
+ * @param options the struct to store the parsed option in.
+ * @return true if the option is valid, false otherwise.
+ */
+static bool parse_option (const char *option, SnakesOptions *options)
+{
+  if (strncmp (option, SEARCH_OPTION, strlen (SEARCH_OPTION)) == 0)
+  {
+    return (sscanf (option, SEARCH_OPTION_FORMAT, &options->num_of_candidates,
+                    &options->num_of_transitions, &options->target_length)
+            == 3) & (options->num_of_candidates > 0)
+           & (options->num_of_transitions >= 0);
+  }
+  if (strncmp (option, THREADS_OPTION, strlen (THREADS_OPTION)) == 0)
+  {
+    return (sscanf (option, THREADS_OPTION_FORMAT, &options->num_of_threads)
+            == 1) & (options->num_of_threads > 0);
+  }
+  if (strncmp (option, TRACE_OPTION, strlen (TRACE_OPTION)) == 0)
+  {
+    options->trace_path = option + strlen (TRACE_OPTION);
+    return true;
+  }
+  return false;
+}
+
+/**
+ * This function extracts the options (arguments starting with "--") from
+ * argv, and moves the remaining arguments to the beginning of argv.
+ * @param argc number of arguments the user entered.
+ * @param argv the arguments the user entered.
+ * @param options the struct to store the parsed options in.
+ * @return the number of the remaining arguments, -1 if an option is invalid.
+ */
+static int parse_options (int argc, char *argv[], SnakesOptions *options)
+{
+  int remaining = 0;
+  for (int i = 0; i < argc; i++)
+  {
+    if (strncmp (argv[i], OPTION_PREFIX, strlen (OPTION_PREFIX)) != 0)
+    {
+      argv[remaining] = argv[i];
+      remaining++;
+    }
+    else if (parse_option (argv[i], options) == false)
+    {
+      printf (OPTION_ERROR, argv[i]);
+      return -1;
+    }
+  }
+  argv[remaining] = NULL;
+  return remaining;
+}
+
 /**
  * This function creates new markov chain.
  * @return pointer to MarkovChain, NULL in case of memory allocation failure.
@@ -192,8 +323,8 @@ static MarkovChain *create_markov_chain ()
   markov_chain->database->size = 0;
   markov_chain->print_func = cell_print_func;
   markov_chain->comp_func = cell_comp_func;
-  markov_chain->free_data = cell_free_data;
-  markov_chain->copy_func = cell_copy_func;
+  markov_chain->free_data = cell_keep_data;
+  markov_chain->copy_func = cell_share_data;
   markov_chain->is_last = cell_is_last;
   return markov_chain;
 }
@@ -210,89 +341,626 @@ static int handle_error (char *error_msg, MarkovChain **database)
 }
 
 
-static int create_board (Cell *cells[BOARD_SIZE])
+/**
+ * This function creates a board of empty cells.
+ * @param board the board to fill
+ * @param size num of cells in the board
+ * @param dice_max num of faces of the die
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int create_board (Board *board, int size, int dice_max)
 {
-    for (int i = 0; i < BOARD_SIZE; i++)
+    board->cells = malloc (size * sizeof (Cell));
+    if (board->cells == NULL)
     {
-        cells[i] = malloc (sizeof(Cell));
-        if (cells[i] == NULL)
-        {
-            for (int j = 0; j < i; j++) {
-                free (cells[j]);
-            }
-            handle_error(ALLOCATION_ERROR_MASSAGE,NULL);
-            return EXIT_FAILURE;
-        }
-        *(cells[i]) = (Cell) {i + 1, EMPTY, EMPTY};
+        return handle_error (ALLOCATION_ERROR_MASSAGE, NULL);
+    }
+    for (int i = 0; i < size; i++)
+    {
+        board->cells[i] = (Cell) {i + 1, EMPTY, EMPTY};
+    }
+    board->size = size;
+    board->dice_max = dice_max;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * This function adds a ladder or a snake to the board.
+ * @param board
+ * @param from the cell the transition starts at
+ * @param to the cell the transition leads to
+ * @return false if the transition does not fit the board, true otherwise.
+ */
+static bool add_transition (Board *board, int from, int to)
+{
+    if ((from < 1) || (from >= board->size) || (to < 1)
+        || (to > board->size) || (from == to))
+    {
+        return false;
+    }
+    Cell *cell = &board->cells[from - 1];
+    if ((cell->ladder_to != EMPTY) || (cell->snake_to != EMPTY))
+    {
+        return false;
+    }
+    if (from < to)
+    {
+        cell->ladder_to = to;
     }
+    else
+    {
+        cell->snake_to = to;
+    }
+    return true;
+}
 
+/**
+ * This function creates the default board, out of the transitions array.
+ * @param board the board to fill
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int create_default_board (Board *board)
+{
+    if (create_board (board, BOARD_SIZE, DICE_MAX) == EXIT_FAILURE)
+    {
+        return EXIT_FAILURE;
+    }
     for (int i = 0; i < NUM_OF_TRANSITIONS; i++)
     {
-        int from = transitions[i][0];
-        int to = transitions[i][1];
-        if (from < to)
-        {
-            cells[from - 1]->ladder_to = to;
-        }
-        else
+        add_transition (board, transitions[i][0], transitions[i][1]);
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * This function loads a board from a file. The first line of the file holds
+ * the num of cells and the num of faces of the die, and every other line
+ * holds a transition "from to", a ladder if from < to or a snake otherwise.
+ * @param board the board to fill
+ * @param path the board file
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int load_board (Board *board, const char *path)
+{
+    FILE *fp = fopen (path, "r");
+    if (fp == NULL)
+    {
+        return handle_error (BOARD_FILE_ERROR, NULL);
+    }
+    int size, dice_max;
+    if ((fscanf (fp, BOARD_HEADER_FORMAT, &size, &dice_max) != 2)
+        || (size < 2) || (dice_max < 1))
+    {
+        fclose (fp);
+        return handle_error (BOARD_FILE_ERROR, NULL);
+    }
+    if (create_board (board, size, dice_max) == EXIT_FAILURE)
+    {
+        fclose (fp);
+        return EXIT_FAILURE;
+    }
+    int from, to, num_of_values;
+    while ((num_of_values = fscanf (fp, TRANSITION_FORMAT, &from, &to)) == 2)
+    {
+        if (add_transition (board, from, to) == false)
         {
-            cells[from - 1]->snake_to = to;
+            break;
         }
     }
+    fclose (fp);
+    if (num_of_values != EOF)
+    {
+        free (board->cells);
+        return handle_error (BOARD_FILE_ERROR, NULL);
+    }
     return EXIT_SUCCESS;
 }
 
 /**
- * fills database
+ * This function checks if a cell has a ladder or a snake.
+ * @param cell
+ * @return true if it does, false otherwise.
+ */
+static bool has_transition (const Cell *cell)
+{
+  return cell->snake_to != EMPTY || cell->ladder_to != EMPTY;
+}
+
+/**
+ * This function finds the cells a walk may go to from a cell: the target of
+ * its ladder or snake if it has one, or the next dice_max cells otherwise,
+ * up to the last cell. Both the markov chain and the board search take
+ * their steps from here.
+ * @param board
+ * @param index index of the cell
+ * @param first_next output, index of the first next cell. The next cells
+ * are consecutive.
+ * @return num of next cells, 0 for the last cell.
+ */
+static int get_next_cells (const Board *board, int index, int *first_next)
+{
+  const Cell *cell = &board->cells[index];
+  if (has_transition (cell))
+  {
+    *first_next = MAX (cell->snake_to, cell->ladder_to) - 1;
+    return 1;
+  }
+  *first_next = index + 1;
+  return MIN (board->dice_max, board->size - cell->number);
+}
+
+/**
+ * This function fills the counter list of a single cell with its next cells.
+ * @param board
+ * @param nodes the markov nodes of the board's cells, by index, each with a
+ * place for its next cells
+ * @param index index of the cell
+ */
+static void fill_counter_list (const Board *board, MarkovNode *nodes,
+                               int index)
+{
+  int first_next;
+  int num_of_next = get_next_cells (board, index, &first_next);
+  for (int j = 0; j < num_of_next; j++)
+  {
+    nodes[index].counter_list[j] = (NextNodeCounter) {&nodes[first_next + j],
+                                                      1};
+  }
+}
+
+/**
+ * fills database in time linear in the num of cells and transitions: the
+ * cells are appended at once, referencing the board's cells, with their
+ * nodes and counter lists in a single allocation, and the next cells of each
+ * are found by index.
  * @param markov_chain
+ * @param board the board to build the chain of, must outlive the chain
  * @return EXIT_SUCCESS or EXIT_FAILURE
  */
-static int fill_database (MarkovChain *markov_chain)
+static int fill_database (MarkovChain *markov_chain, const Board *board)
 {
-  Cell* cells[BOARD_SIZE];
-  if (create_board (cells) == EXIT_FAILURE)
+  int *num_of_next_nodes = malloc (board->size * sizeof (int));
+  if (num_of_next_nodes == NULL)
+  {
+    return handle_error (ALLOCATION_ERROR_MASSAGE, NULL);
+  }
+  for (int i = 0; i < board->size; i++)
+  {
+    int first_next;
+    num_of_next_nodes[i] = get_next_cells (board, i, &first_next);
+  }
+  MarkovNode *nodes = append_states_to_database (markov_chain, board->cells,
+                                                 sizeof (Cell), board->size,
+                                                 num_of_next_nodes);
+  free (num_of_next_nodes);
+  if (nodes == NULL)
   {
     return EXIT_FAILURE;
   }
-  MarkovNode *from_node = NULL, *to_node = NULL;
-  size_t index_to;
-  for (size_t i = 0; i < BOARD_SIZE; i++)
+  for (int i = 0; i < board->size; i++)
   {
-    add_to_database (markov_chain, cells[i]);
+    fill_counter_list (board, nodes, i);
   }
+  return EXIT_SUCCESS;
+}
 
-  for (size_t i = 0; i < BOARD_SIZE; i++)
+/**
+ * This function clears the transitions of the worker's previous candidate and
+ * draws the transitions of the given one. The draw depends only on the seed
+ * and the candidate's index, so a candidate can be drawn again by any worker.
+ * @param worker
+ * @param candidate index of the candidate board
+ */
+static void draw_candidate (SearchWorker *worker, int candidate)
+{
+  Board *board = &worker->board;
+  int num_of_transitions = worker->options->num_of_transitions;
+  for (int i = 0; i < num_of_transitions; i++)
   {
-    from_node = get_node_from_database (markov_chain,cells[i])->data;
+    int from = worker->board_transitions[i][0];
+    if (from > 0)
+    {
+      board->cells[from - 1].ladder_to = EMPTY;
+      board->cells[from - 1].snake_to = EMPTY;
+    }
+  }
+  unsigned int rand_state = worker->seed + candidate * CANDIDATE_SEED_STEP;
+  for (int i = 0; i < num_of_transitions; i++)
+  {
+    int from, to;
+    do
+    {
+      from = 2 + rand_r (&rand_state) % (board->size - 2);
+      to = 1 + rand_r (&rand_state) % board->size;
+    }
+    while (add_transition (board, from, to) == false);
+    worker->board_transitions[i][0] = from;
+    worker->board_transitions[i][1] = to;
+  }
+}
 
-    if (cells[i]->snake_to != EMPTY || cells[i]->ladder_to != EMPTY)
+/**
+ * This function marks the cells the last cell can be reached from. It sweeps
+ * the board down, tracking the closest marked cell above the current one, and
+ * sweeps again while a ladder or a snake leads to a newly marked cell.
+ * @param board
+ * @param can_finish output, a mark for each cell
+ */
+static void mark_can_finish (const Board *board, bool *can_finish)
+{
+  memset (can_finish, 0, board->size * sizeof (bool));
+  can_finish[board->size - 1] = true;
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+    int closest = board->size - 1;
+    for (int i = board->size - 2; i >= 0; i--)
     {
-      index_to = MAX (cells[i]->snake_to,cells[i]->ladder_to) - 1;
-      to_node = get_node_from_database (markov_chain, cells[index_to])
-          ->data;
-      add_node_to_counter_list (from_node, to_node, markov_chain);
+      if (!can_finish[i])
+      {
+        int first_next;
+        int num_of_next = get_next_cells (board, i, &first_next);
+        can_finish[i] = has_transition (&board->cells[i])
+                        ? can_finish[first_next]
+                        : (closest < first_next + num_of_next);
+        changed |= can_finish[i];
+      }
+      if (can_finish[i])
+      {
+        closest = i;
+      }
     }
-    else
+  }
+}
+
+/**
+ * This function marks the cells a walk from the first cell may visit. It
+ * sweeps the board up, tracking how far the marked cells without a ladder or
+ * a snake reach, and sweeps again while a snake leads back to a newly marked
+ * cell.
+ * @param board
+ * @param reachable output, a mark for each cell
+ */
+static void mark_reachable (const Board *board, bool *reachable)
+{
+  memset (reachable, 0, board->size * sizeof (bool));
+  reachable[0] = true;
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+    int reach_end = 0; // cells below it follow a marked cell by a roll
+    for (int i = 0; i < board->size; i++)
+    {
+      if (!reachable[i] && (i < reach_end))
+      {
+        reachable[i] = true;
+        changed = true;
+      }
+      if (!reachable[i])
+      {
+        continue;
+      }
+      int first_next;
+      int num_of_next = get_next_cells (board, i, &first_next);
+      if (!has_transition (&board->cells[i]))
+      {
+        reach_end = first_next + num_of_next;
+        continue;
+      }
+      if (!reachable[first_next])
+      {
+        reachable[first_next] = true;
+        changed |= (first_next < i);
+      }
+    }
+  }
+}
+
+/**
+ * This function checks that every walk from the first cell of the worker's
+ * board ends in the last cell, so its expected length is finite.
+ * @param worker
+ * @return true if it does, false otherwise.
+ */
+static bool is_board_finite (SearchWorker *worker)
+{
+  const Board *board = &worker->board;
+  mark_can_finish (board, worker->can_finish);
+  mark_reachable (board, worker->reachable);
+  for (int i = 0; i < board->size; i++)
+  {
+    if (worker->reachable[i] && !worker->can_finish[i])
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * This function computes the expected num of steps of a walk from the first
+ * cell of the worker's board to the last one, and its variance. It solves
+ * E[i] = 1 + mean(E[next]) and S[i] = 1 + mean(2 * E[next] + S[next]) by
+ * Gauss-Seidel sweeps from the last cell down, keeping a sliding sum over the
+ * next dice_max cells so each sweep is linear in the board size. Cells a walk
+ * never visits are left at 0.
+ * @param worker
+ * @param score output, the expected length and variance of the board
+ * @return false if the walk may never reach the last cell, true otherwise.
+ */
+static bool evaluate_board (SearchWorker *worker, BoardScore *score)
+{
+  const Board *board = &worker->board;
+  if (!is_board_finite (worker))
+  {
+    return false;
+  }
+  double *expected = worker->expected, *second = worker->second_moment;
+  memset (expected, 0, board->size * sizeof (double));
+  memset (second, 0, board->size * sizeof (double));
+  for (int sweep = 0; sweep < MAX_SWEEPS; sweep++)
+  {
+    double max_change = 0, window_expected = 0, window_second = 0;
+    for (int i = board->size - 2; i >= 0; i--)
+    {
+      window_expected += expected[i + 1];
+      window_second += second[i + 1];
+      if (i + 1 + board->dice_max < board->size)
+      {
+        window_expected -= expected[i + 1 + board->dice_max];
+        window_second -= second[i + 1 + board->dice_max];
+      }
+      if (!worker->reachable[i])
+      {
+        continue;
+      }
+      double new_expected, new_second;
+      int first_next;
+      int num_of_next = get_next_cells (board, i, &first_next);
+      if (has_transition (&board->cells[i]))
+      {
+        new_expected = 1 + expected[first_next];
+        new_second = 1 + 2 * expected[first_next] + second[first_next];
+      }
+      else
+      {
+        new_expected = 1 + window_expected / num_of_next;
+        new_second = 1 + (2 * window_expected + window_second) / num_of_next;
+      }
+      max_change = MAX (max_change, fabs (new_second - second[i])
+                                    / MAX (1, new_second));
+      expected[i] = new_expected;
+      second[i] = new_second;
+    }
+    if (max_change < CONVERGENCE_EPSILON)
+    {
+      score->expected_length = expected[0];
+      score->variance = second[0] - expected[0] * expected[0];
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * This function inserts a board's score into a list of the closest boards
+ * to the target length, if it is close enough. Ties are broken by the
+ * candidate's index, so the result does not depend on the num of threads.
+ * @param top list of SEARCH_TOP scores, closest first
+ * @param score the score to insert
+ * @param target_length
+ */
+static void insert_score (BoardScore top[SEARCH_TOP], BoardScore score,
+                          double target_length)
+{
+  double distance = fabs (score.expected_length - target_length);
+  int i = SEARCH_TOP;
+  while (i > 0)
+  {
+    double top_distance = fabs (top[i - 1].expected_length - target_length);
+    if ((top[i - 1].candidate != -1) && ((top_distance < distance)
+        || ((top_distance == distance) && (top[i - 1].candidate
+                                           < score.candidate))))
+    {
+      break;
+    }
+    if (i < SEARCH_TOP)
+    {
+      top[i] = top[i - 1];
+    }
+    i--;
+  }
+  if (i < SEARCH_TOP)
+  {
+    top[i] = score;
+  }
+}
+
+/**
+ * This function evaluates the worker's range of candidate boards. It runs as
+ * a thread, and allocates nothing.
+ * @param arg pointer to the SearchWorker to work with.
+ * @return NULL.
+ */
+static void *search_boards (void *arg)
+{
+  SearchWorker *worker = arg;
+  for (int candidate = worker->first_candidate;
+       candidate < worker->last_candidate; candidate++)
+  {
+    draw_candidate (worker, candidate);
+    BoardScore score = {candidate, 0, 0};
+    if (evaluate_board (worker, &score))
+    {
+      insert_score (worker->top, score, worker->options->target_length);
+    }
+  }
+  return NULL;
+}
+
+/**
+ * This function frees the buffers of a search worker.
+ * @param worker
+ */
+static void free_search_worker (SearchWorker *worker)
+{
+  free (worker->board.cells);
+  free (worker->board_transitions);
+  free (worker->expected);
+  free (worker->second_moment);
+  free (worker->reachable);
+  free (worker->can_finish);
+}
+
+/**
+ * This function allocates the buffers of a search worker, once for all the
+ * candidates it evaluates.
+ * @param worker the worker to initialize
+ * @param base_board the board whose size and die every candidate shares
+ * @param options
+ * @param seed
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int init_search_worker (SearchWorker *worker, const Board *base_board,
+                               const SnakesOptions *options, unsigned int seed)
+{
+  worker->base_board = base_board;
+  worker->options = options;
+  worker->seed = seed;
+  worker->board_transitions = calloc (options->num_of_transitions + 1,
+                                      sizeof (*worker->board_transitions));
+  worker->expected = malloc (base_board->size * sizeof (double));
+  worker->second_moment = malloc (base_board->size * sizeof (double));
+  worker->reachable = malloc (base_board->size * sizeof (bool));
+  worker->can_finish = malloc (base_board->size * sizeof (bool));
+  worker->board.cells = NULL;
+  for (int i = 0; i < SEARCH_TOP; i++)
+  {
+    worker->top[i] = (BoardScore) {-1, 0, 0};
+  }
+  if ((worker->board_transitions == NULL) | (worker->expected == NULL)
+      | (worker->second_moment == NULL) | (worker->reachable == NULL)
+      | (worker->can_finish == NULL)
+      || (create_board (&worker->board, base_board->size,
+                        base_board->dice_max) == EXIT_FAILURE))
+  {
+    free_search_worker (worker);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+/**
+ * This function prints the boards closest to the target length, with their
+ * transitions.
+ * @param worker a worker to draw the boards again with
+ * @param top list of SEARCH_TOP scores, closest first
+ */
+static void print_top_boards (SearchWorker *worker,
+                              const BoardScore top[SEARCH_TOP])
+{
+  for (int i = 0; (i < SEARCH_TOP) && (top[i].candidate != -1); i++)
+  {
+    draw_candidate (worker, top[i].candidate);
+    printf (BOARD_SCORE_FORMAT, PRINT_BOARD, top[i].candidate + 1,
+            top[i].expected_length, top[i].variance);
+    for (int j = 0; j < worker->options->num_of_transitions; j++)
     {
-      for (int j = 1; j <= DICE_MAX; j++)
+      printf (PRINT_TRANSITION, worker->board_transitions[j][0],
+              worker->board_transitions[j][1]);
+    }
+    printf ("%s", LINE_BREAK);
+  }
+}
+
+/**
+ * This function draws random sets of ladders and snakes on boards of the
+ * base board's size and die, evaluates them in parallel, and prints the ones
+ * whose expected game length is the closest to the target.
+ * @param base_board
+ * @param options the num of candidates, transitions, target and threads
+ * @param seed
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int search_board_designs (const Board *base_board,
+                                 const SnakesOptions *options,
+                                 unsigned int seed)
+{
+  if (options->num_of_transitions > base_board->size - 2)
+  {
+    printf (SEARCH_ERROR, base_board->size, base_board->size - 2);
+    return EXIT_FAILURE;
+  }
+  int num_of_threads = options->num_of_threads;
+  SearchWorker *workers = malloc (num_of_threads * sizeof (SearchWorker));
+  pthread_t *threads = malloc (num_of_threads * sizeof (pthread_t));
+  if ((workers == NULL) | (threads == NULL))
+  {
+    free (workers);
+    free (threads);
+    return handle_error (ALLOCATION_ERROR_MASSAGE, NULL);
+  }
+  int num_of_workers = 0;
+  for (; num_of_workers < num_of_threads; num_of_workers++)
+  {
+    SearchWorker *worker = &workers[num_of_workers];
+    if (init_search_worker (worker, base_board, options, seed)
+        == EXIT_FAILURE)
+    {
+      break;
+    }
+    worker->first_candidate = (int) ((long int) options->num_of_candidates
+                                     * num_of_workers / num_of_threads);
+    worker->last_candidate = (int) ((long int) options->num_of_candidates
+                                    * (num_of_workers + 1) / num_of_threads);
+  }
+  int status = EXIT_SUCCESS;
+  if (num_of_workers < num_of_threads)
+  {
+    status = handle_error (ALLOCATION_ERROR_MASSAGE, NULL);
+  }
+  else
+  {
+    int started = 0;
+    for (int i = 1; i < num_of_workers; i++)
+    {
+      if (pthread_create (&threads[i], NULL, search_boards, &workers[i]) != 0)
+      {
+        break;
+      }
+      started = i;
+    }
+    search_boards (&workers[0]);
+    for (int i = started + 1; i < num_of_workers; i++)
+    {
+      search_boards (&workers[i]);
+    }
+    for (int i = 1; i <= started; i++)
+    {
+      pthread_join (threads[i], NULL);
+    }
+    for (int i = 1; i < num_of_workers; i++)
+    {
+      for (int j = 0; j < SEARCH_TOP; j++)
       {
-        index_to = ((Cell*) (from_node->data))->number + j - 1;
-        if (index_to >= BOARD_SIZE)
+        if (workers[i].top[j].candidate != -1)
         {
-          break;
+          insert_score (workers[0].top, workers[i].top[j],
+                        options->target_length);
         }
-        to_node = get_node_from_database (markov_chain, cells[index_to])
-            ->data;
-        add_node_to_counter_list (from_node, to_node, markov_chain);
       }
     }
+    print_top_boards (&workers[0], workers[0].top);
   }
-  // free temp arr
-  for (size_t i = 0; i < BOARD_SIZE; i++)
+  for (int i = 0; i < num_of_workers; i++)
   {
-    free (cells[i]);
+    free_search_worker (&workers[i]);
   }
-  return EXIT_SUCCESS;
+  free (workers);
+  free (threads);
+  return status;
 }
 
 /**
@@ -317,30 +985,86 @@ sequences_to_create)
  * @param argc num of arguments
  * @param argv 1) Seed
  *             2) Number of sentences to generate
+ *             3) Optional board file, the default board if not given
+ *             Options: --search=<candidates>,<transitions>,<target length>,
+ *             --threads=<num of threads> and --trace=<trace file>
  * @return EXIT_SUCCESS or EXIT_FAILURE
  */
 int main(int argc, char *argv[])
 {
-  long int seed = convert_char_to_int (argv[1]);
-  long int num_of_route = convert_char_to_int (argv[2]);
-  if (argc != THREE_ARGS)
+  SnakesOptions options = {0, 0, 0, (int) sysconf (_SC_NPROCESSORS_ONLN),
+                           NULL};
+  argc = parse_options (argc, argv, &options);
+  if (argc == -1)
+  {
+    return EXIT_FAILURE;
+  }
+  if (options.num_of_threads < 1)
+  {
+    options.num_of_threads = 1;
+  }
+  if ((argc != THREE_ARGS) && (argc != FOUR_ARGS))
   {
     printf ("%s\n", NUM_OF_ARGC_ERROR_SNL);
     return EXIT_FAILURE;
   }
-  MarkovChain *markov_chain = create_markov_chain();
-  if (markov_chain == NULL)
+  if ((options.trace_path != NULL) && !trace_start (options.trace_path))
   {
-    printf ("%s", ALLOCATION_ERROR_MASSAGE);
+    printf ("%s", TRACE_ERROR);
     return EXIT_FAILURE;
   }
-  if (fill_database (markov_chain) == 1)
+  long int seed = convert_char_to_int (argv[1]);
+  long int num_of_route = convert_char_to_int (argv[2]);
+  Board board;
+  trace_begin (LOAD_BOARD_PHASE);
+  int status = (argc == FOUR_ARGS) ? load_board (&board, argv[3])
+                                   : create_default_board (&board);
+  trace_end ();
+  if (status == EXIT_FAILURE)
+  {
+    trace_finish ();
+    return EXIT_FAILURE;
+  }
+  board_size = board.size;
+  if (options.num_of_candidates > 0)
+  {
+    trace_begin (SEARCH_PHASE);
+    status = search_board_designs (&board, &options, (unsigned int) seed);
+    trace_end ();
+  }
+  MarkovChain *markov_chain = NULL;
+  if (status == EXIT_SUCCESS)
+  {
+    markov_chain = create_markov_chain();
+    if (markov_chain == NULL)
+    {
+      status = handle_error (ALLOCATION_ERROR_MASSAGE, NULL);
+    }
+  }
+  if (status == EXIT_SUCCESS)
   {
+    trace_begin (FILL_DATABASE_PHASE);
+    status = fill_database (markov_chain, &board);
+    trace_end ();
+  }
+  if (status == EXIT_SUCCESS)
+  {
+    trace_begin (GENERATE_PHASE);
+    srand (seed);
+    generate_sequences (markov_chain, num_of_route);
+    trace_end ();
+  }
+  if (markov_chain != NULL)
+  {
+    trace_begin (FREE_PHASE);
     free_markov_chain (&markov_chain);
+    trace_end ();
+  }
+  free (board.cells); // after the chain, which references its cells
+  if (!trace_finish ())
+  {
+    printf ("%s", TRACE_ERROR);
     return EXIT_FAILURE;
   }
-  srand (seed);
-  generate_sequences (markov_chain, num_of_route);
-  free_markov_chain (&markov_chain);
-  return EXIT_SUCCESS;
+  return status;
 }
@@ -0,0 +1,169 @@
+#include "string_pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define INITIAL_CAPACITY 1024
+#define BLOCK_SIZE (64 * 1024)
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+/**
+ * struct holds a block of interned strings, one after the other
+ */
+typedef struct StringBlock {
+    struct StringBlock *next;
+    size_t used; // num of bytes of data in use
+    size_t capacity; // num of bytes of data
+    char data[];
+} StringBlock;
+
+/**
+ * This function hashes a string with FNV-1a.
+ * @param str
+ * @return the hash of str.
+ */
+static uint32_t hash_string (const char *str)
+{
+  uint32_t hash = FNV_OFFSET_BASIS;
+  for (; *str != '\0'; str++)
+  {
+    hash = (hash ^ (unsigned char) *str) * FNV_PRIME;
+  }
+  return hash;
+}
+
+/**
+ * This function finds the slot of a string in a table: the slot holding it,
+ * or the empty slot it would go to.
+ * @param table
+ * @param capacity num of slots in table, a power of 2
+ * @param str
+ * @return index of the slot.
+ */
+static size_t find_slot (const char **table, size_t capacity, const char *str)
+{
+  size_t slot = hash_string (str) & (capacity - 1);
+  while ((table[slot] != NULL) && (strcmp (table[slot], str) != 0))
+  {
+    slot = (slot + 1) & (capacity - 1);
+  }
+  return slot;
+}
+
+/**
+ * This function doubles the capacity of the pool's table.
+ * @param pool
+ * @return 0 on success, 1 in case of allocation failure.
+ */
+static int grow_table (StringPool *pool)
+{
+  size_t capacity = 2 * pool->capacity;
+  const char **table = calloc (capacity, sizeof (const char *));
+  if (table == NULL)
+  {
+    return 1;
+  }
+  for (size_t i = 0; i < pool->capacity; i++)
+  {
+    if (pool->table[i] != NULL)
+    {
+      table[find_slot (table, capacity, pool->table[i])] = pool->table[i];
+    }
+  }
+  free (pool->table);
+  pool->table = table;
+  pool->capacity = capacity;
+  return 0;
+}
+
+/**
+ * This function copies a string into the pool's blocks.
+ * @param pool
+ * @param str
+ * @return the copy, NULL in case of allocation failure.
+ */
+static char *store_string (StringPool *pool, const char *str)
+{
+  size_t len = strlen (str) + 1;
+  StringBlock *block = pool->blocks;
+  if ((block == NULL) || (block->capacity - block->used < len))
+  {
+    size_t capacity = (len > BLOCK_SIZE) ? len : BLOCK_SIZE;
+    block = malloc (sizeof (StringBlock) + capacity);
+    if (block == NULL)
+    {
+      return NULL;
+    }
+    block->next = pool->blocks;
+    block->used = 0;
+    block->capacity = capacity;
+    pool->blocks = block;
+  }
+  char *copy = block->data + block->used;
+  memcpy (copy, str, len);
+  block->used += len;
+  return copy;
+}
+
+StringPool *create_string_pool (void)
+{
+  StringPool *pool = malloc (sizeof (StringPool));
+  if (pool == NULL)
+  {
+    return NULL;
+  }
+  pool->table = calloc (INITIAL_CAPACITY, sizeof (const char *));
+  if (pool->table == NULL)
+  {
+    free (pool);
+    return NULL;
+  }
+  pool->capacity = INITIAL_CAPACITY;
+  pool->size = 0;
+  pool->blocks = NULL;
+  return pool;
+}
+
+const char *intern_string (StringPool *pool, const char *str)
+{
+  size_t slot = find_slot (pool->table, pool->capacity, str);
+  if (pool->table[slot] != NULL)
+  {
+    return pool->table[slot];
+  }
+  if (2 * (pool->size + 1) > pool->capacity)
+  {
+    if (grow_table (pool) == 1)
+    {
+      return NULL;
+    }
+    slot = find_slot (pool->table, pool->capacity, str);
+  }
+  char *copy = store_string (pool, str);
+  if (copy == NULL)
+  {
+    return NULL;
+  }
+  pool->table[slot] = copy;
+  pool->size++;
+  return copy;
+}
+
+void free_string_pool (StringPool **ptr_pool)
+{
+  if (*ptr_pool == NULL)
+  {
+    return;
+  }
+  StringPool *pool = *ptr_pool;
+  while (pool->blocks != NULL)
+  {
+    StringBlock *next = pool->blocks->next;
+    free (pool->blocks);
+    pool->blocks = next;
+  }
+  free (pool->table);
+  free (pool);
+  *ptr_pool = NULL;
+}
@@ -0,0 +1,38 @@
+#ifndef _STRING_POOL_H_
+#define _STRING_POOL_H_
+#include <stddef.h> // for size_t
+
+/**
+ * struct holds a set of interned strings: every distinct string is stored
+ * once, in large blocks, and found by a hash table of pointers to it
+ */
+typedef struct StringPool {
+    const char **table; // open addressing, NULL for an empty slot
+    size_t capacity; // num of slots in table, a power of 2
+    size_t size; // num of distinct strings
+    struct StringBlock *blocks; // the blocks holding the strings
+} StringPool;
+
+/**
+ * Create a new, empty string pool.
+ * @return pointer to the new StringPool, NULL in case of allocation failure.
+ */
+StringPool *create_string_pool(void);
+
+/**
+ * Find the pool's copy of a string, adding a copy if there is none. Equal
+ * strings are interned to the same pointer, so they may be compared with ==.
+ * The copy stays valid until the pool is freed.
+ * @param pool
+ * @param str the string to intern
+ * @return the pool's copy of str, NULL in case of allocation failure.
+ */
+const char *intern_string(StringPool *pool, const char *str);
+
+/**
+ * Free the pool and all the strings it holds.
+ * @param ptr_pool pointer to the pool to free, set to NULL
+ */
+void free_string_pool(StringPool **ptr_pool);
+
+#endif //_STRING_POOL_H_
@@ -1,7 +1,22 @@
+#define _POSIX_C_SOURCE 200809L // For strtok_r(), sysconf(), clock_gettime()
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <sched.h>
+#include <time.h>
 #include "markov_chain.h"
+#include "phase_trace.h"
+#include "numa_replica.h"
+#include "string_pool.h"
+#include "line_dedup.h"
+#include "input_stream.h"
+#include "bloom_filter.h"
+#include "chain_snapshot.h"
+#include "worker_pool.h"
 
 /***************************/
 /*         DEFINE          */
@@ -16,10 +31,205 @@
 #define PRINT_TWEET "Tweet"
 #define LINE_BREAK "\n"
 #define PATH_ERROR "Error: The given file is invalid.\n"
+#define DECOMPRESS_ERROR "Error: The given file is corrupt or truncated.\n"
 #define MAX_LINE_LEN 1001
 #define MAX_WORD_LEN 101
 #define DELIM " \n\t\r"
 #define DOT '.'
+#define OPTION_PREFIX "--"
+#define DECAY_OPTION "--decay="
+#define DECAY_OPTION_FORMAT "--decay=%lf,%d,%ld"
+#define SCORE_OPTION "--score="
+#define THREADS_OPTION "--threads="
+#define THREADS_OPTION_FORMAT "--threads=%d"
+#define TRACE_OPTION "--trace="
+#define TRACE_TOKENS_OPTION "--trace-tokens"
+#define COMPRESS_OPTION "--compress"
+#define NUMA_OPTION "--numa"
+#define SPLIT_OPTION "--split="
+#define SPLIT_BY_HASHTAG_NAME "hashtag"
+#define SPLIT_BY_FILE_NAME "file"
+#define INPUT_OPTION "--input="
+#define MODELS_OPTION "--models="
+#define MODELS_SEPARATOR ","
+#define INPUT_ERROR "Usage: --input and --models need --split\n"
+#define MAX_INPUTS 64
+#define PRINT_MODEL "Model"
+#define HASHTAG_PREFIX '#'
+#define ASCII_MAX 127
+#define INITIAL_MODELS 16
+#define POINTER_HASH_MULTIPLIER 11400714819323198485u
+#define DEDUP_OPTION "--dedup="
+#define DEDUP_OPTION_FORMAT "--dedup=%15[a-z],%ld"
+#define DEDUP_EXACT_NAME "exact"
+#define DEDUP_NEAR_NAME "near"
+#define MAX_DEDUP_NAME_LEN 16
+#define DEFAULT_DEDUP_KB 16384
+#define BYTES_IN_KB 1024
+#define DUPLICATES_COUNTER "duplicate_lines"
+#define UNIQUE_OPTION "--unique"
+#define UNIQUE_OPTION_FORMAT "--unique=%ld"
+#define DEFAULT_UNIQUE_RETRIES 100
+#define UNIQUE_ERROR "Usage: --unique can't be used with --numa\n"
+#define SEEN_BITS_PER_TWEET 16
+#define PRINT_UNIQUE "Unique"
+#define UNIQUE_FORMAT "%s: %ld tweets, %ld attempts wasted on duplicates, \
+%ld tweets given up\n"
+#define WASTED_ATTEMPTS_COUNTER "wasted_attempts"
+#define SEQUENCE_HASH_SEED 0x9e3779b97f4a7c15u
+#define SEQUENCE_HASH_MULTIPLIER 0xbf58476d1ce4e5b9u
+#define SEQUENCE_HASH_SHIFT 31
+#define BOUNDED_OPTION "--bounded"
+#define DISTANCES_PHASE "distances"
+#define LIVE_OPTION_FORMAT "--live=%d,%ld"
+#define LIVE_OPTION "--live="
+#define LIVE_ERROR "Usage: --live can't be used with --split\n"
+#define PRINT_LIVE "Live"
+#define LIVE_FORMAT "%s: %ld snapshots published, %ld freed during training, \
+%ld tweets by %d readers, mean latency %.1f us, max latency %.1f us\n"
+#define SNAPSHOTS_COUNTER "snapshots"
+#define LIVE_TWEETS_COUNTER "live_tweets"
+#define MICROS_IN_SECOND 1e6
+#define MICROS_IN_NANO 1e-3
+#define OPTION_ERROR "Usage: Unknown or invalid option %s\n"
+#define TRACE_ERROR "Error: The given trace file can't be written.\n"
+#define TRACE_TOKENS_INTERVAL 1000000
+#define TOKENS_COUNTER "tokens"
+#define OPEN_FILE_PHASE "open_file"
+#define FILL_DATABASE_PHASE "fill_database"
+#define COMPRESS_PHASE "compress"
+#define SCORE_PHASE "score"
+#define GENERATE_PHASE "generate"
+#define FREE_PHASE "free_markov_chain"
+#define PRINT_SCORE "Score"
+#define SCORE_FORMAT "%s %ld: log-probability %.4f, perplexity %.4f, unseen \
+%d/%d\n"
+#define SCORE_BATCH_LINES 4096
+#define MAX_WORDS_IN_LINE (MAX_LINE_LEN / 2 + 1)
+#define REPLICATE_PHASE "replicate"
+#define TWEETS_PER_ROUND 4096
+#define TWEET_SEED_STEP 2654435761u
+#define TWEET_HEADER_FORMAT "%s %ld:"
+
+/***************************/
+
+/***************************/
+/*        STRUCTS          */
+/***************************/
+
+/**
+ * enum of the ways to split the input between several models
+ */
+typedef enum SplitMode {
+    NO_SPLIT, // a single model of the whole input
+    SPLIT_BY_HASHTAG, // a model per hashtag, of the lines that have it
+    SPLIT_BY_FILE // a model per input file
+} SplitMode;
+
+/**
+ * enum of the ways to skip repeated lines of the input
+ */
+typedef enum DedupMode {
+    NO_DEDUP,
+    DEDUP_EXACT, // skip lines of the same words as a line seen before
+    DEDUP_NEAR // skip near duplicates too
+} DedupMode;
+
+/**
+ * struct holds the optional modes the program was asked to run with
+ */
+typedef struct GeneratorOptions {
+    double decay_factor; // 0 if the decay mode is off
+    int decay_min_frequency; // states and transitions below it are evicted
+    long int decay_interval; // num of words to read between decay steps
+    const char *score_path; // file of lines to score, NULL if not scoring
+    int num_of_threads; // num of threads to run the parallel modes with
+    const char *trace_path; // file to write the phase trace to, or NULL
+    bool trace_tokens; // whether to sample the trace every million words
+    bool compress; // whether to compress the chain once trained
+    bool numa; // whether to generate from per-NUMA-node replicas
+    SplitMode split; // how to split the input between models
+    const char *input_paths[MAX_INPUTS]; // more input files, for split modes
+    int num_of_inputs;
+    char *model_names; // models to build, comma separated, NULL for all
+    DedupMode dedup; // how to skip repeated lines
+    long int dedup_kb; // maximal memory of the seen lines' fingerprints
+    long int unique_retries; // retries per unique tweet, 0 if not unique
+    bool bounded; // whether every tweet must end on a last word in time
+    int live_readers; // threads generating while training, 0 if not live
+    long int live_interval; // num of words to read between snapshots
+} GeneratorOptions;
+
+/**
+ * struct holds a batch of lines to score and the scores computed for them
+ */
+typedef struct ScoreBatch {
+    MarkovScorer *scorer;
+    char (*lines)[MAX_LINE_LEN];
+    SequenceScore *scores;
+    int num_of_lines;
+} ScoreBatch;
+
+/**
+ * struct holds the slice of a batch a single scoring thread works on
+ */
+typedef struct ScoreTask {
+    ScoreBatch *batch;
+    int first_line;
+    int last_line;
+} ScoreTask;
+
+/**
+ * struct holds the tweets a single generating thread works on, and the text
+ * it generated for them
+ */
+typedef struct GenerateTask {
+    ChainReplica *replica; // the replica local to the thread's node
+    unsigned int seed;
+    long int first_tweet;
+    long int last_tweet;
+    char *text;
+    size_t text_len;
+    size_t text_capacity;
+    bool failed; // whether allocating the text failed
+    bool bounded; // whether every tweet must end on a last word in time
+} GenerateTask;
+
+/**
+ * struct holds a thread that generates tweets from the published snapshots
+ * of a chain while it is trained, and its measures
+ */
+typedef struct LiveReader {
+    SnapshotPublisher *publisher;
+    int id;
+    unsigned int seed;
+    const bool *training; // cleared by the writer once training is done
+    long int num_of_tweets;
+    double total_latency_us;
+    double max_latency_us;
+    bool failed; // whether allocating the text of a tweet failed
+} LiveReader;
+
+/**
+ * struct holds a named model of a split training
+ */
+typedef struct Model {
+    const char *name; // interned in the word pool
+    MarkovChain *markov_chain;
+} Model;
+
+/**
+ * struct holds the models of a split training, found by name
+ */
+typedef struct ModelSet {
+    Model *models; // by order of creation
+    int num_of_models;
+    int capacity;
+    int *table; // open addressing by name pointer, index of model or -1
+    int table_capacity; // a power of 2, at least twice capacity
+    bool fixed; // whether the models were listed, and no more are created
+    StringPool *word_pool; // the names and words of every model
+} ModelSet;
 
 /***************************/
 
@@ -48,6 +258,21 @@ static int s_comp_func (const void *data_1, const void *data_2)
   return strcmp(str_1, str_2);
 }
 
+/**
+ * This function compares 2 strings interned in the same word pool, where
+ * equal strings are the same pointer.
+ * @param data_1 pointer to the first string.
+ * @param data_2 pointer to the second string.
+ * @return 0 if the strings are equal, otherwise 1 or -1 by the order of their
+ * addresses.
+ */
+static int s_pooled_comp_func (const void *data_1, const void *data_2)
+{
+  uintptr_t str_1 = (uintptr_t) data_1;
+  uintptr_t str_2 = (uintptr_t) data_2;
+  return (str_1 > str_2) - (str_1 < str_2);
+}
+
 /**
  * This function free a the data of a string.
  * @param data pointer to char type object.
@@ -75,6 +300,27 @@ static void* s_copy_func (void const *data)
   return strcpy (copy_str, str_data);
 }
 
+/**
+ * This function keeps the data of a string interned in the word pool, so
+ * every model shares a single copy of it.
+ * @param data pointer to a string interned in the word pool.
+ * @return the same pointer.
+ */
+static void* s_share_data (void const *data)
+{
+  return (void *) data;
+}
+
+/**
+ * This function does not free a string interned in the word pool, as it is
+ * freed with the pool.
+ * @param data pointer to a string interned in the word pool.
+ */
+static void s_keep_data (void *data)
+{
+  (void) data;
+}
+
 /**
  * This function checks is a string ends with '.'.
  * @param word
@@ -105,22 +351,156 @@ static long int convert_char_to_int (char *num_in_char)
  * @param argv the arguments the user entered.
  * @return EXIT_SUCCESS if the user's input is valid, EXIT_FAILURE otherwise.
  */
-static bool check_args_validity (int argc, const char *path)
+static bool check_args_validity (int argc, char *argv[])
 {
   if ((argc != FOUR_ARGC) & (argc != FIVE_ARGC))
   {
     printf ("%s", NUM_OF_ARGC_ERROR_TWEETS);
     return false;
   }
-  FILE *in_file = fopen (path, "r");
+  FILE *in_file = fopen (argv[3], "r");
   if (in_file == NULL)
   {
     printf ("%s", PATH_ERROR);
     return false;
   }
+  fclose (in_file);
   return true;
 }
 
+/**
+ * This function parses a single option of the form --name=value.
+ * @param option the option the user entered.
+ * @param options the struct to store the parsed option in.
+ * @return true if the option is valid, false otherwise.
+ */
+static bool parse_option (const char *option, GeneratorOptions *options)
+{
+  if (strncmp (option, SCORE_OPTION, strlen (SCORE_OPTION)) == 0)
+  {
+    options->score_path = option + strlen (SCORE_OPTION);
+    return true;
+  }
+  if (strncmp (option, THREADS_OPTION, strlen (THREADS_OPTION)) == 0)
+  {
+    return (sscanf (option, THREADS_OPTION_FORMAT, &options->num_of_threads)
+            == 1) & (options->num_of_threads > 0);
+  }
+  if (strncmp (option, TRACE_OPTION, strlen (TRACE_OPTION)) == 0)
+  {
+    options->trace_path = option + strlen (TRACE_OPTION);
+    return true;
+  }
+  if (strcmp (option, TRACE_TOKENS_OPTION) == 0)
+  {
+    options->trace_tokens = true;
+    return true;
+  }
+  if (strcmp (option, COMPRESS_OPTION) == 0)
+  {
+    options->compress = true;
+    return true;
+  }
+  if (strcmp (option, NUMA_OPTION) == 0)
+  {
+    options->numa = true;
+    return true;
+  }
+  if (strncmp (option, SPLIT_OPTION, strlen (SPLIT_OPTION)) == 0)
+  {
+    const char *mode = option + strlen (SPLIT_OPTION);
+    options->split = (strcmp (mode, SPLIT_BY_HASHTAG_NAME) == 0)
+                     ? SPLIT_BY_HASHTAG
+                     : (strcmp (mode, SPLIT_BY_FILE_NAME) == 0)
+                       ? SPLIT_BY_FILE : NO_SPLIT;
+    return options->split != NO_SPLIT;
+  }
+  if (strncmp (option, INPUT_OPTION, strlen (INPUT_OPTION)) == 0)
+  {
+    if (options->num_of_inputs == MAX_INPUTS)
+    {
+      return false;
+    }
+    options->input_paths[options->num_of_inputs] =
+        option + strlen (INPUT_OPTION);
+    options->num_of_inputs++;
+    return true;
+  }
+  if (strncmp (option, LIVE_OPTION, strlen (LIVE_OPTION)) == 0)
+  {
+    return (sscanf (option, LIVE_OPTION_FORMAT, &options->live_readers,
+                    &options->live_interval) == 2)
+           & (options->live_readers > 0) & (options->live_interval > 0);
+  }
+  if (strcmp (option, BOUNDED_OPTION) == 0)
+  {
+    options->bounded = true;
+    return true;
+  }
+  if (strcmp (option, UNIQUE_OPTION) == 0)
+  {
+    options->unique_retries = DEFAULT_UNIQUE_RETRIES;
+    return true;
+  }
+  if (strncmp (option, UNIQUE_OPTION "=", strlen (UNIQUE_OPTION "=")) == 0)
+  {
+    return (sscanf (option, UNIQUE_OPTION_FORMAT, &options->unique_retries)
+            == 1) & (options->unique_retries > 0);
+  }
+  if (strncmp (option, DEDUP_OPTION, strlen (DEDUP_OPTION)) == 0)
+  {
+    char mode[MAX_DEDUP_NAME_LEN];
+    int num_of_fields = sscanf (option, DEDUP_OPTION_FORMAT, mode,
+                                &options->dedup_kb);
+    options->dedup = (num_of_fields < 1) ? NO_DEDUP
+        : (strcmp (mode, DEDUP_EXACT_NAME) == 0) ? DEDUP_EXACT
+        : (strcmp (mode, DEDUP_NEAR_NAME) == 0) ? DEDUP_NEAR : NO_DEDUP;
+    return (options->dedup != NO_DEDUP) & (options->dedup_kb > 0);
+  }
+  if (strncmp (option, MODELS_OPTION, strlen (MODELS_OPTION)) == 0)
+  {
+    options->model_names = (char *) option + strlen (MODELS_OPTION);
+    return true;
+  }
+  if (strncmp (option, DECAY_OPTION, strlen (DECAY_OPTION)) == 0)
+  {
+    return (sscanf (option, DECAY_OPTION_FORMAT, &options->decay_factor,
+                    &options->decay_min_frequency, &options->decay_interval)
+            == 3) & (options->decay_factor > 0) & (options->decay_factor <= 1)
+           & (options->decay_min_frequency >= 1)
+           & (options->decay_interval > 0);
+  }
+  return false;
+}
+
+/**
+ * This function extracts the options (arguments starting with "--") from
+ * argv, and moves the remaining arguments to the beginning of argv.
+ * @param argc number of arguments the user entered.
+ * @param argv the arguments the user entered.
+ * @param options the struct to store the parsed options in.
+ * @return the number of the remaining arguments, -1 if an option is invalid.
+ */
+static int parse_options (int argc, char *argv[], GeneratorOptions *options)
+{
+  int remaining = 0;
+  for (int i = 0; i < argc; i++)
+  {
+    if (strncmp (argv[i], OPTION_PREFIX, strlen (OPTION_PREFIX)) != 0)
+    {
+      argv[remaining] = argv[i];
+      remaining++;
+    }
+    else if (parse_option (argv[i], options) == false)
+    {
+      printf (OPTION_ERROR, argv[i]);
+      return -1;
+    }
+  }
+  argv[remaining] = NULL;
+  return remaining;
+}
+
 /**
  * This function creates new markov chain.
  * @return pointer to MarkovChain, NULL in case of memory allocation failure.
@@ -162,19 +542,20 @@ static MarkovChain *create_markov_chain ()
  * means the all file should be read.
  * @param beginning_of_line a flag that says whether the current word appears
  * at the beginning of a line or not
+ * @param words_read counter of the words read so far, updated by the function.
  * @return EXIT_FAILURE in case of memory allocation failure, EXIT_SUCCESS
  * otherwise.
  */
 static int parse_line (long int *words_to_read, MarkovChain
 *markov_chain, char *token_1, char *token_2, int words_limit_flag,
-                int beginning_of_line)
+                int beginning_of_line, long int *words_read)
 {
   while ((token_2 != NULL) & (0 < *words_to_read))
   {
-    Node *second_node = get_node_from_database (markov_chain, token_2);
+    Node *second_node = add_to_database (markov_chain, token_2);
     if (second_node == NULL)
     {
-      second_node = add_to_database (markov_chain, token_2);
+      return EXIT_FAILURE;
     }
     if (beginning_of_line == 0)
     {
@@ -193,6 +574,7 @@ static int parse_line (long int *words_to_read, MarkovChain
     {
       (*words_to_read)--;
     }
+    (*words_read)++;
     beginning_of_line = 0;
     strcpy (token_1, token_2);
     token_2 = strtok (NULL, DELIM);
@@ -206,11 +588,25 @@ static int parse_line (long int *words_to_read, MarkovChain
  * @param words_to_read If the number of words to be read is limited then the
  * number of the words itself, and if not then 0.
  * @param markov_chain a pointer to the markov chain.
- * @return
+ * @param options the modes to train the chain with. In decay mode, the chain
+ * is decayed every decay_interval words, so its size stays bounded on an
+ * endless input and the recent words dominate it. If trace_tokens is set, a
+ * trace sample is taken every TRACE_TOKENS_INTERVAL words.
+ * @param line_dedup filter of repeated lines, skipped before they are split
+ * to words, or NULL to read every line.
+ * @param publisher where to publish a snapshot of the chain every
+ * live_interval words, or NULL.
+ * @return EXIT_FAILURE in case of memory allocation failure, EXIT_SUCCESS
+ * otherwise.
  */
 static int fill_database (FILE *fp, long int words_to_read, MarkovChain
-*markov_chain)
+*markov_chain, const GeneratorOptions *options, LineDedup *line_dedup,
+                          SnapshotPublisher *publisher)
 {
+  long int words_read = 0;
+  long int next_publication = options->live_interval;
+  long int next_decay = options->decay_interval;
+  long int next_trace_sample = TRACE_TOKENS_INTERVAL;
   int words_limit_flag = 1;
   if (words_to_read == 0)
   {
@@ -220,69 +616,1326 @@ static int fill_database (FILE *fp, long int words_to_read, MarkovChain
   char new_line[MAX_LINE_LEN];
   while (fgets (new_line, MAX_LINE_LEN, fp) != NULL)
   {
+    if ((line_dedup != NULL) && is_duplicate_line (line_dedup, new_line))
+    {
+      continue;
+    }
     char token_1[MAX_WORD_LEN];
     char *token_2;
     token_2 = strtok (new_line, DELIM);
     if (parse_line (&words_to_read, markov_chain, token_1, token_2,
-                    words_limit_flag, 1) == EXIT_FAILURE){
+                    words_limit_flag, 1, &words_read) == EXIT_FAILURE){
       return EXIT_FAILURE;
     }
+    if ((options->decay_factor > 0) & (words_read >= next_decay))
+    {
+      decay_markov_chain (markov_chain, options->decay_factor,
+                          options->decay_min_frequency);
+      next_decay = words_read + options->decay_interval;
+    }
+    if (options->trace_tokens & (words_read >= next_trace_sample))
+    {
+      trace_counter (TOKENS_COUNTER, words_read);
+      next_trace_sample = words_read + TRACE_TOKENS_INTERVAL;
+    }
+    if ((publisher != NULL) && (words_read >= next_publication))
+    {
+      if (!publish_snapshot (publisher, markov_chain, options->compress))
+      {
+        return EXIT_FAILURE;
+      }
+      next_publication = words_read + options->live_interval;
+    }
   }
   return EXIT_SUCCESS;
 }
 
 /**
- * This function generates random sequences.
- * @param markov_chain
- * @param tweet_to_create num of tweets to generates.
+ * This function splits a line to words, the same way fill_database does.
+ * @param line the line to split, modified by the function.
+ * @param tokens output, pointers to the words in line.
+ * @return num of words in the line.
  */
-void generate_sequences (MarkovChain *markov_chain, long int
-tweet_to_create)
+static int split_line (char *line, void *tokens[MAX_WORDS_IN_LINE])
 {
-  for (int i = 0; i < tweet_to_create; i++)
+  char *save_ptr;
+  int num_of_tokens = 0;
+  char *token = strtok_r (line, DELIM, &save_ptr);
+  while (token != NULL)
   {
-    printf ("%s %d:", PRINT_TWEET, i+1);
-    MarkovNode *first_node = get_first_random_node (markov_chain);
-    generate_random_sequence (markov_chain, first_node, MAX_WORDS_IN_TWEET);
-    printf ("%s", LINE_BREAK);
+    tokens[num_of_tokens] = token;
+    num_of_tokens++;
+    token = strtok_r (NULL, DELIM, &save_ptr);
   }
+  return num_of_tokens;
 }
 
-int main (int argc, char *argv[])
+/**
+ * This function creates a markov chain whose words are interned in the word
+ * pool, for a split training. Its states are compared by pointer, so it
+ * must be switched to s_comp_func before words from outside the pool are
+ * looked up in it.
+ * @return pointer to MarkovChain, NULL in case of memory allocation failure.
+ */
+static MarkovChain *create_pooled_markov_chain ()
 {
-  long int seed = convert_char_to_int (argv[1]);
-  long int num_of_tweets = convert_char_to_int (argv[2]);
-  const char *path = argv[3];
-  long int words_to_read = 0;
-  if (!check_args_validity (argc, path))
+  MarkovChain *markov_chain = create_markov_chain ();
+  if (markov_chain == NULL)
   {
-    return EXIT_FAILURE;
+    return NULL;
   }
-  if (argc == FIVE_ARGC)
+  markov_chain->comp_func = s_pooled_comp_func;
+  markov_chain->copy_func = s_share_data;
+  markov_chain->free_data = s_keep_data;
+  return markov_chain;
+}
+
+/**
+ * This function interns a string in a word pool.
+ * @param word_pool
+ * @param str
+ * @return the pool's copy of str, NULL in case of memory allocation failure.
+ */
+static const char *intern_word (StringPool *word_pool, const char *str)
+{
+  const char *interned = intern_string (word_pool, str);
+  if (interned == NULL)
   {
-    words_to_read = convert_char_to_int (argv[4]);
+    printf ("%s", ALLOCATION_ERROR_MASSAGE);
   }
-  FILE *in_file = fopen (path, "r");
-  if (in_file == NULL)
+  return interned;
+}
+
+/**
+ * This function finds the slot of a model name in the table of a model set:
+ * the slot holding it, or the empty slot it would go to.
+ * @param model_set
+ * @param name name interned in the word pool
+ * @return index of the slot.
+ */
+static int find_model_slot (const ModelSet *model_set, const char *name)
+{
+  int mask = model_set->table_capacity - 1;
+  int slot = (int) (((uintptr_t) name * POINTER_HASH_MULTIPLIER) >> 32) & mask;
+  while ((model_set->table[slot] != -1)
+         && (model_set->models[model_set->table[slot]].name != name))
   {
-    printf ("%s", PATH_ERROR);
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+/**
+ * This function doubles the capacity of a model set.
+ * @param model_set
+ * @return EXIT_FAILURE in case of memory allocation failure, EXIT_SUCCESS
+ * otherwise.
+ */
+static int grow_model_set (ModelSet *model_set)
+{
+  int capacity = (model_set->capacity == 0) ? INITIAL_MODELS
+                                            : 2 * model_set->capacity;
+  Model *models = realloc (model_set->models, capacity * sizeof (Model));
+  int *table = malloc (2 * capacity * sizeof (int));
+  if ((models == NULL) | (table == NULL))
+  {
+    if (models != NULL)
+    {
+      model_set->models = models;
+    }
+    free (table);
     return EXIT_FAILURE;
   }
-  MarkovChain *markov_chain = create_markov_chain ();
-  if (markov_chain == NULL)
+  free (model_set->table);
+  model_set->models = models;
+  model_set->capacity = capacity;
+  model_set->table = table;
+  model_set->table_capacity = 2 * capacity;
+  for (int i = 0; i < model_set->table_capacity; i++)
+  {
+    table[i] = -1;
+  }
+  for (int i = 0; i < model_set->num_of_models; i++)
+  {
+    table[find_model_slot (model_set, models[i].name)] = i;
+  }
+  return EXIT_SUCCESS;
+}
+
+/**
+ * This function finds the model of a name, and creates it if it is new and
+ * the models of the set are not fixed.
+ * @param model_set
+ * @param name name interned in the word pool
+ * @param model output, the model, or NULL if it is not built
+ * @return EXIT_FAILURE in case of memory allocation failure, EXIT_SUCCESS
+ * otherwise.
+ */
+static int get_model (ModelSet *model_set, const char *name, Model **model)
+{
+  *model = NULL;
+  if (model_set->capacity > 0)
+  {
+    int slot = find_model_slot (model_set, name);
+    if (model_set->table[slot] != -1)
+    {
+      *model = &model_set->models[model_set->table[slot]];
+      return EXIT_SUCCESS;
+    }
+  }
+  if (model_set->fixed)
+  {
+    return EXIT_SUCCESS;
+  }
+  MarkovChain *markov_chain = NULL;
+  if (((model_set->num_of_models == model_set->capacity)
+       && (grow_model_set (model_set) == EXIT_FAILURE))
+      || ((markov_chain = create_pooled_markov_chain ()) == NULL))
   {
     printf ("%s", ALLOCATION_ERROR_MASSAGE);
     return EXIT_FAILURE;
   }
-  if (fill_database (in_file, words_to_read, markov_chain) == 1)
+  int index = model_set->num_of_models;
+  model_set->models[index] = (Model) {name, markov_chain};
+  model_set->table[find_model_slot (model_set, name)] = index;
+  model_set->num_of_models++;
+  *model = &model_set->models[index];
+  return EXIT_SUCCESS;
+}
+
+/**
+ * This function free a model set and the chains of its models.
+ * @param model_set
+ */
+static void free_model_set (ModelSet *model_set)
+{
+  for (int i = 0; i < model_set->num_of_models; i++)
   {
-    fclose (in_file);
-    free_markov_chain (&markov_chain);
-    return EXIT_FAILURE;
+    free_markov_chain (&model_set->models[i].markov_chain);
+  }
+  free (model_set->models);
+  free (model_set->table);
+}
+
+/**
+ * This function finds the hashtag a word is, and normalizes it: a hashtag is
+ * '#' followed by letters, digits, '_' or non-ASCII bytes, in lower case,
+ * without the punctuation after it.
+ * @param word
+ * @param hashtag output, the normalized hashtag
+ * @return true if the word is a hashtag, false otherwise.
+ */
+static bool get_hashtag (const char *word, char hashtag[MAX_WORD_LEN])
+{
+  if (word[0] != HASHTAG_PREFIX)
+  {
+    return false;
+  }
+  int len = 1;
+  hashtag[0] = HASHTAG_PREFIX;
+  for (const unsigned char *c = (const unsigned char *) word + 1;
+       (len < MAX_WORD_LEN - 1)
+       && (isalnum (*c) || (*c == '_') || (*c > ASCII_MAX)); c++)
+  {
+    hashtag[len] = (char) tolower (*c);
+    len++;
+  }
+  hashtag[len] = '\0';
+  return len > 1;
+}
+
+/**
+ * This function creates the models listed by the user, in order, and fixes
+ * the set so no other model is created.
+ * @param model_set
+ * @param model_names the names, comma separated, modified by the function
+ * @param split how the input is split, hashtags are normalized
+ * @return EXIT_FAILURE in case of memory allocation failure, EXIT_SUCCESS
+ * otherwise.
+ */
+static int create_listed_models (ModelSet *model_set, char *model_names,
+                                 SplitMode split)
+{
+  char *save_ptr;
+  char hashtag[MAX_WORD_LEN];
+  for (char *name = strtok_r (model_names, MODELS_SEPARATOR, &save_ptr);
+       name != NULL; name = strtok_r (NULL, MODELS_SEPARATOR, &save_ptr))
+  {
+    if ((split == SPLIT_BY_HASHTAG) && get_hashtag (name, hashtag))
+    {
+      name = hashtag;
+    }
+    const char *interned = intern_word (model_set->word_pool, name);
+    Model *model;
+    if ((interned == NULL)
+        || (get_model (model_set, interned, &model) == EXIT_FAILURE))
+    {
+      return EXIT_FAILURE;
+    }
+  }
+  model_set->fixed = true;
+  return EXIT_SUCCESS;
+}
+
+/**
+ * This function adds the words of a single line to a markov chain, as
+ * parse_line does.
+ * @param markov_chain
+ * @param tokens the words of the line, interned in the word pool
+ * @param num_of_tokens
+ * @return EXIT_FAILURE in case of memory allocation failure, EXIT_SUCCESS
+ * otherwise.
+ */
+static int add_line_to_chain (MarkovChain *markov_chain, void **tokens,
+                              int num_of_tokens)
+{
+  MarkovNode *prev_node = NULL;
+  for (int i = 0; i < num_of_tokens; i++)
+  {
+    Node *node = add_to_database (markov_chain, tokens[i]);
+    if (node == NULL)
+    {
+      return EXIT_FAILURE;
+    }
+    if ((prev_node != NULL) && (s_is_last (prev_node->data) == false)
+        && (add_node_to_counter_list (prev_node, node->data, markov_chain)
+            == false))
+    {
+      return EXIT_FAILURE;
+    }
+    prev_node = node->data;
   }
-  srand (seed);
-  generate_sequences (markov_chain, num_of_tweets);
-  fclose (in_file);
-  free_markov_chain (&markov_chain);
   return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
+
+/**
+ * This function finds the chains a line is routed to: the chains of the
+ * models of its hashtags, or the chain of the model of its file. Chains are
+ * returned rather than models, as creating a model may move the others.
+ * @param model_set
+ * @param tokens the words of the line, interned in the word pool
+ * @param num_of_tokens
+ * @param file_chain the chain of the line's file, NULL if split by hashtag
+ * @param routes output, the chains, each one once
+ * @return num of chains, -1 in case of memory allocation failure.
+ */
+static int route_line (ModelSet *model_set, void **tokens, int num_of_tokens,
+                       MarkovChain *file_chain,
+                       MarkovChain *routes[MAX_WORDS_IN_LINE])
+{
+  if (file_chain != NULL)
+  {
+    routes[0] = file_chain;
+    return 1;
+  }
+  int num_of_routes = 0;
+  char hashtag[MAX_WORD_LEN];
+  for (int i = 0; i < num_of_tokens; i++)
+  {
+    if (!get_hashtag (tokens[i], hashtag))
+    {
+      continue;
+    }
+    const char *name = intern_word (model_set->word_pool, hashtag);
+    Model *model;
+    if ((name == NULL)
+        || (get_model (model_set, name, &model) == EXIT_FAILURE))
+    {
+      return -1;
+    }
+    if (model == NULL)
+    {
+      continue;
+    }
+    int j = 0;
+    while ((j < num_of_routes) && (routes[j] != model->markov_chain))
+    {
+      j++;
+    }
+    if (j == num_of_routes)
+    {
+      routes[num_of_routes] = model->markov_chain;
+      num_of_routes++;
+    }
+  }
+  return num_of_routes;
+}
+
+/**
+ * This function fills the models of a split training in a single pass over
+ * the input files. Each line is split to words once, its words are interned
+ * once in the word pool, and it is added to every model it is routed to.
+ * @param paths the input files
+ * @param num_of_paths
+ * @param words_to_read If the number of words to be read is limited then the
+ * number of the words itself, and if not then 0.
+ * @param model_set
+ * @param options the modes to train the models with, as in fill_database.
+ * Decay steps decay every model. A pool only grows: the words of evicted
+ * states stay in it until the end of the run, as other models may still
+ * share them.
+ * @param line_dedup filter of repeated lines, as in fill_database, or NULL.
+ * @return EXIT_FAILURE in case of invalid file or memory allocation failure,
+ * EXIT_SUCCESS otherwise.
+ */
+static int fill_models (const char **paths, int num_of_paths,
+                        long int words_to_read, ModelSet *model_set,
+                        const GeneratorOptions *options,
+                        LineDedup *line_dedup)
+{
+  long int words_read = 0;
+  long int next_decay = options->decay_interval;
+  long int next_trace_sample = TRACE_TOKENS_INTERVAL;
+  char new_line[MAX_LINE_LEN];
+  void *tokens[MAX_WORDS_IN_LINE];
+  MarkovChain *routes[MAX_WORDS_IN_LINE];
+  for (int k = 0; k < num_of_paths; k++)
+  {
+    InputStream *in_stream = open_input_stream (paths[k]);
+    if (in_stream == NULL)
+    {
+      printf ("%s", PATH_ERROR);
+      return EXIT_FAILURE;
+    }
+    FILE *fp = in_stream->fp;
+    MarkovChain *file_chain = NULL;
+    if (options->split == SPLIT_BY_FILE)
+    {
+      const char *name = intern_word (model_set->word_pool, paths[k]);
+      Model *file_model;
+      if ((name == NULL)
+          || (get_model (model_set, name, &file_model) == EXIT_FAILURE))
+      {
+        close_input_stream (&in_stream);
+        return EXIT_FAILURE;
+      }
+      file_chain = (file_model == NULL) ? NULL : file_model->markov_chain;
+    }
+    int status = EXIT_SUCCESS;
+    while ((status == EXIT_SUCCESS)
+           && ((words_to_read == 0) || (words_read < words_to_read))
+           && ((options->split != SPLIT_BY_FILE) || (file_chain != NULL))
+           && (fgets (new_line, MAX_LINE_LEN, fp) != NULL))
+    {
+      if ((line_dedup != NULL) && is_duplicate_line (line_dedup, new_line))
+      {
+        continue;
+      }
+      int num_of_tokens = split_line (new_line, tokens);
+      if ((words_to_read != 0)
+          && (num_of_tokens > words_to_read - words_read))
+      {
+        num_of_tokens = (int) (words_to_read - words_read);
+      }
+      for (int i = 0; (status == EXIT_SUCCESS) && (i < num_of_tokens); i++)
+      {
+        tokens[i] = (void *) intern_word (model_set->word_pool, tokens[i]);
+        status = (tokens[i] == NULL) ? EXIT_FAILURE : EXIT_SUCCESS;
+      }
+      words_read += num_of_tokens;
+      int num_of_routes = (status == EXIT_FAILURE) ? -1
+          : route_line (model_set, tokens, num_of_tokens, file_chain, routes);
+      status = (num_of_routes == -1) ? EXIT_FAILURE : EXIT_SUCCESS;
+      for (int i = 0; (status == EXIT_SUCCESS) && (i < num_of_routes); i++)
+      {
+        status = add_line_to_chain (routes[i], tokens, num_of_tokens);
+      }
+      if ((options->decay_factor > 0) & (words_read >= next_decay))
+      {
+        for (int i = 0; i < model_set->num_of_models; i++)
+        {
+          decay_markov_chain (model_set->models[i].markov_chain,
+                              options->decay_factor,
+                              options->decay_min_frequency);
+        }
+        next_decay = words_read + options->decay_interval;
+      }
+      if (options->trace_tokens & (words_read >= next_trace_sample))
+      {
+        trace_counter (TOKENS_COUNTER, words_read);
+        next_trace_sample = words_read + TRACE_TOKENS_INTERVAL;
+      }
+    }
+    if (!close_input_stream (&in_stream) && (status == EXIT_SUCCESS))
+    {
+      printf ("%s", DECOMPRESS_ERROR);
+      status = EXIT_FAILURE;
+    }
+    if (status == EXIT_FAILURE)
+    {
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+/**
+ * This function scores a slice of a batch of lines. It runs on a worker.
+ * @param arg pointer to the ScoreTask to work on.
+ * @return NULL.
+ */
+static void *score_lines (void *arg)
+{
+  ScoreTask *task = arg;
+  void *tokens[MAX_WORDS_IN_LINE];
+  for (int i = task->first_line; i < task->last_line; i++)
+  {
+    int num_of_tokens = split_line (task->batch->lines[i], tokens);
+    task->batch->scores[i] = score_sequence (task->batch->scorer, tokens,
+                                             num_of_tokens);
+  }
+  return NULL;
+}
+
+/**
+ * This function scores a batch of lines, split between the workers of a
+ * pool.
+ * @param batch the batch to score.
+ * @param pool the workers to score the batch with.
+ * @param tasks the slice of each worker, num_of_threads of them.
+ * @param args pointers to tasks, as run_worker_pool takes them.
+ * @param num_of_threads num of workers of the pool.
+ */
+static void score_batch (ScoreBatch *batch, WorkerPool *pool,
+                         ScoreTask *tasks, void **args, int num_of_threads)
+{
+  for (int i = 0; i < num_of_threads; i++)
+  {
+    tasks[i] = (ScoreTask) {batch, batch->num_of_lines * i / num_of_threads,
+                            batch->num_of_lines * (i + 1) / num_of_threads};
+    args[i] = &tasks[i];
+  }
+  run_worker_pool (pool, score_lines, args);
+}
+
+/**
+ * This function scores every line of a file against the markov chain, and
+ * prints the log-probability, perplexity and num of unseen transitions of
+ * each line. The lines are read and scored in batches, each one split
+ * between the same threads, and the chain is not modified. Its scoring
+ * tables are built once, before the first batch.
+ * @param markov_chain the trained chain.
+ * @param path the file of lines to score.
+ * @param num_of_threads num of threads to score each batch with.
+ * @return EXIT_FAILURE in case of invalid file or memory allocation failure,
+ * EXIT_SUCCESS otherwise.
+ */
+static int score_file (MarkovChain *markov_chain, const char *path,
+                       int num_of_threads)
+{
+  InputStream *in_stream = open_input_stream (path);
+  if (in_stream == NULL)
+  {
+    printf ("%s", PATH_ERROR);
+    return EXIT_FAILURE;
+  }
+  FILE *fp = in_stream->fp;
+  ScoreBatch batch;
+  batch.scorer = create_markov_scorer (markov_chain);
+  batch.lines = malloc (SCORE_BATCH_LINES * sizeof (*batch.lines));
+  batch.scores = malloc (SCORE_BATCH_LINES * sizeof (SequenceScore));
+  ScoreTask *tasks = malloc (num_of_threads * sizeof (ScoreTask));
+  void **args = malloc (num_of_threads * sizeof (void *));
+  WorkerPool *pool = create_worker_pool (num_of_threads, NULL, NULL);
+  bool allocated = (batch.scorer != NULL) & (batch.lines != NULL)
+                   & (batch.scores != NULL) & (tasks != NULL)
+                   & (args != NULL) & (pool != NULL);
+  long int line_number = 0;
+  bool more_lines = allocated;
+  while (more_lines)
+  {
+    batch.num_of_lines = 0;
+    while ((batch.num_of_lines < SCORE_BATCH_LINES)
+           && (fgets (batch.lines[batch.num_of_lines], MAX_LINE_LEN, fp)
+               != NULL))
+    {
+      batch.num_of_lines++;
+    }
+    score_batch (&batch, pool, tasks, args, num_of_threads);
+    for (int i = 0; i < batch.num_of_lines; i++)
+    {
+      SequenceScore score = batch.scores[i];
+      line_number++;
+      printf (SCORE_FORMAT, PRINT_SCORE, line_number, score.log_prob,
+              score.perplexity, score.num_of_unseen,
+              score.num_of_transitions);
+    }
+    more_lines = (batch.num_of_lines == SCORE_BATCH_LINES);
+  }
+  free_worker_pool (&pool);
+  free_markov_scorer (&batch.scorer);
+  free (batch.lines);
+  free (batch.scores);
+  free (tasks);
+  free (args);
+  if (!allocated)
+  {
+    printf ("%s", ALLOCATION_ERROR_MASSAGE);
+    close_input_stream (&in_stream);
+    return EXIT_FAILURE;
+  }
+  if (!close_input_stream (&in_stream))
+  {
+    printf ("%s", DECOMPRESS_ERROR);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+/**
+ * This function generates random sequences.
+ * @param markov_chain
+ * @param tweet_to_create num of tweets to generates.
+ */
+void generate_sequences (MarkovChain *markov_chain, long int
+tweet_to_create)
+{
+  for (int i = 0; i < tweet_to_create; i++)
+  {
+    printf ("%s %d:", PRINT_TWEET, i+1);
+    MarkovNode *first_node = get_first_random_node (markov_chain);
+    generate_random_sequence (markov_chain, first_node, MAX_WORDS_IN_TWEET);
+    printf ("%s", LINE_BREAK);
+  }
+}
+
+/**
+ * This function prints a single tweet, as generate_sequences does.
+ * @param markov_chain
+ * @param tweet_num
+ * @param sequence the states of the tweet
+ * @param length num of states
+ */
+static void print_tweet (MarkovChain *markov_chain, long int tweet_num,
+                         MarkovNode **sequence, int length)
+{
+  printf ("%s %ld:", PRINT_TWEET, tweet_num);
+  for (int j = 0; j < length; j++)
+  {
+    markov_chain->print_func (sequence[j]->data);
+  }
+  printf ("%s", LINE_BREAK);
+}
+
+/**
+ * This function generates a single random tweet into an array.
+ * @param markov_chain
+ * @param generator the bounded generator of the chain, if the tweet must end
+ * on a last word within MAX_WORDS_IN_TWEET words, NULL otherwise.
+ * @param sequence output, with a place for MAX_WORDS_IN_TWEET states
+ * @return num of states of the tweet.
+ */
+static int generate_tweet (MarkovChain *markov_chain,
+                           const BoundedGenerator *generator,
+                           MarkovNode **sequence)
+{
+  if (generator != NULL)
+  {
+    return generate_bounded_sequence_to_array (generator, MAX_WORDS_IN_TWEET,
+                                               sequence);
+  }
+  MarkovNode *first_node = get_first_random_node (markov_chain);
+  return (first_node == NULL) ? 0
+      : generate_random_sequence_to_array (markov_chain, first_node,
+                                           MAX_WORDS_IN_TWEET, sequence);
+}
+
+/**
+ * This function generates random sequences that all end on a last word
+ * within MAX_WORDS_IN_TWEET words, so none is cut short.
+ * @param generator the bounded generator of the chain
+ * @param tweet_to_create num of tweets to generate.
+ */
+static void generate_bounded_sequences (const BoundedGenerator *generator,
+                                        long int tweet_to_create)
+{
+  MarkovNode *sequence[MAX_WORDS_IN_TWEET];
+  for (long int i = 0; i < tweet_to_create; i++)
+  {
+    int length = generate_tweet (generator->markov_chain, generator,
+                                 sequence);
+    print_tweet (generator->markov_chain, i + 1, sequence, length);
+  }
+}
+
+/**
+ * This function hashes a sequence by the addresses of its states, as every
+ * state holds a different word.
+ * @param sequence
+ * @param length
+ * @return the hash of the sequence.
+ */
+static uint64_t hash_sequence (MarkovNode **sequence, int length)
+{
+  uint64_t hash = SEQUENCE_HASH_SEED;
+  for (int i = 0; i < length; i++)
+  {
+    hash = (hash ^ (uintptr_t) sequence[i]) * SEQUENCE_HASH_MULTIPLIER;
+    hash ^= hash >> SEQUENCE_HASH_SHIFT;
+  }
+  return hash;
+}
+
+/**
+ * This function generates random sequences as generate_sequences does, all
+ * different from each other. Every sequence is hashed, and the hashes are
+ * kept in a Bloom filter of SEEN_BITS_PER_TWEET bits per tweet. A sequence
+ * seen before is generated again, up to max_retries times, and if all the
+ * retries are seen too the tweet is given up. The Bloom filter may reject a
+ * new sequence, but never lets a repeated one through. The num of tweets,
+ * of attempts wasted on duplicates and of tweets given up is printed last.
+ * @param markov_chain
+ * @param tweet_to_create num of tweets to generate.
+ * @param max_retries num of retries per tweet.
+ * @param generator the bounded generator of the chain, if every tweet must
+ * end on a last word in time, as generate_bounded_sequences does, or NULL.
+ * @return EXIT_FAILURE in case of memory allocation failure, EXIT_SUCCESS
+ * otherwise.
+ */
+static int generate_unique_sequences (MarkovChain *markov_chain,
+                                      long int tweet_to_create,
+                                      long int max_retries,
+                                      const BoundedGenerator *generator)
+{
+  BloomFilter *seen = create_bloom_filter ((size_t) tweet_to_create,
+                                           SEEN_BITS_PER_TWEET);
+  if (seen == NULL)
+  {
+    printf ("%s", ALLOCATION_ERROR_MASSAGE);
+    return EXIT_FAILURE;
+  }
+  MarkovNode *sequence[MAX_WORDS_IN_TWEET];
+  long int num_of_tweets = 0, wasted_attempts = 0, given_up = 0;
+  for (long int i = 0; i < tweet_to_create; i++)
+  {
+    int length = 0;
+    bool is_new = false;
+    for (long int attempt = 0; !is_new && (attempt <= max_retries); attempt++)
+    {
+      length = generate_tweet (markov_chain, generator, sequence);
+      is_new = !test_and_add_hash (seen, hash_sequence (sequence, length));
+      wasted_attempts += !is_new;
+    }
+    if (!is_new)
+    {
+      given_up++;
+      continue;
+    }
+    num_of_tweets++;
+    print_tweet (markov_chain, num_of_tweets, sequence, length);
+  }
+  printf (UNIQUE_FORMAT, PRINT_UNIQUE, num_of_tweets, wasted_attempts,
+          given_up);
+  trace_counter (WASTED_ATTEMPTS_COUNTER, wasted_attempts);
+  free_bloom_filter (&seen);
+  return EXIT_SUCCESS;
+}
+
+/**
+ * This function chooses a random first state of a replica, as
+ * get_first_random_node does, in constant time.
+ * @param replica
+ * @param seed random state of the caller
+ * @return MarkovNode of the chosen state, NULL if no state may start a
+ * sequence.
+ */
+static MarkovNode *choose_replica_first_node (const ChainReplica *replica,
+                                              unsigned int *seed)
+{
+  if (replica->num_of_first_states == 0)
+  {
+    return NULL;
+  }
+  return replica->first_states[rand_r (seed)
+                               % replica->num_of_first_states];
+}
+
+/**
+ * This function appends a single tweet to a text, formatted as
+ * generate_sequences prints it. The text grows to fit the tweet.
+ * @param text in/out, the text, may be NULL if its capacity is 0
+ * @param text_len in/out, num of chars in the text
+ * @param text_capacity in/out, num of chars the text has place for
+ * @param tweet_num
+ * @param sequence the states of the tweet, whose data are strings
+ * @param length num of states
+ * @return false in case of memory allocation failure, true otherwise.
+ */
+static bool append_tweet (char **text, size_t *text_len,
+                          size_t *text_capacity, long int tweet_num,
+                          MarkovNode **sequence, int length)
+{
+  size_t tweet_len = snprintf (NULL, 0, TWEET_HEADER_FORMAT, PRINT_TWEET,
+                               tweet_num) + strlen (LINE_BREAK);
+  for (int j = 0; j < length; j++)
+  {
+    tweet_len += 1 + strlen ((char *) sequence[j]->data);
+  }
+  if (*text_capacity - *text_len <= tweet_len)
+  {
+    size_t capacity = 2 * *text_capacity + tweet_len + 1;
+    char *new_text = realloc (*text, capacity);
+    if (new_text == NULL)
+    {
+      return false;
+    }
+    *text = new_text;
+    *text_capacity = capacity;
+  }
+  char *end = *text + *text_len;
+  end += sprintf (end, TWEET_HEADER_FORMAT, PRINT_TWEET, tweet_num);
+  for (int j = 0; j < length; j++)
+  {
+    end += sprintf (end, " %s", (char *) sequence[j]->data);
+  }
+  end += sprintf (end, "%s", LINE_BREAK);
+  *text_len = end - *text;
+  return true;
+}
+
+/**
+ * This function generates the tweets of a task into its text, formatted as
+ * generate_sequences prints them.
+ * @param arg pointer to the GenerateTask to work on.
+ * @return NULL.
+ */
+static void *generate_tweets (void *arg)
+{
+  GenerateTask *task = arg;
+  MarkovNode *sequence[MAX_WORDS_IN_TWEET];
+  task->text_len = 0;
+  for (long int i = task->first_tweet; i < task->last_tweet; i++)
+  {
+    unsigned int seed = task->seed + (unsigned int) i * TWEET_SEED_STEP;
+    MarkovNode *first_node = task->bounded ? NULL
+        : choose_replica_first_node (task->replica, &seed);
+    int length = task->bounded
+        ? generate_bounded_sequence_to_array_r (task->replica->generator,
+                                                MAX_WORDS_IN_TWEET, sequence,
+                                                &seed)
+        : (first_node == NULL) ? 0
+        : generate_random_sequence_to_array_r (task->replica->markov_chain,
+                                               first_node, MAX_WORDS_IN_TWEET,
+                                               sequence, &seed);
+    if (!append_tweet (&task->text, &task->text_len, &task->text_capacity,
+                       i + 1, sequence, length))
+    {
+      task->failed = true;
+      return NULL;
+    }
+  }
+  return NULL;
+}
+
+/**
+ * This function pins a worker thread to the node of a replica, so the
+ * tweets it generates read only memory local to it.
+ * @param arg pointer to the ChainReplica of the worker.
+ * @return NULL.
+ */
+static void *bind_to_replica_node (void *arg)
+{
+  ChainReplica *replica = arg;
+  bind_to_numa_node (replica->numa_node);
+  return NULL;
+}
+
+/**
+ * This function generates random sequences from replicas of the chain, one
+ * per NUMA node, each read only by threads pinned to its node. The tweets
+ * are generated in rounds, split between the threads, and printed in order.
+ * Tweet i is drawn from its own random state, derived from seed and i, so
+ * the output does not depend on the num of threads or nodes. The threads are
+ * started and pinned once, and reused by every round. If a thread fails to
+ * start, its tweets are generated by the caller, which is never pinned.
+ * @param markov_chain the trained chain, not modified
+ * @param tweet_to_create num of tweets to generate
+ * @param seed
+ * @param num_of_threads
+ * @param bounded whether every tweet must end on a last word in time, as
+ * generate_bounded_sequences does.
+ * @return EXIT_FAILURE in case of memory allocation failure, EXIT_SUCCESS
+ * otherwise.
+ */
+static int generate_sequences_numa (MarkovChain *markov_chain,
+                                    long int tweet_to_create,
+                                    unsigned int seed, int num_of_threads,
+                                    bool bounded)
+{
+  int nodes[MAX_NUMA_NODES];
+  trace_begin (REPLICATE_PHASE);
+  int num_of_nodes = get_numa_nodes (nodes);
+  if (num_of_nodes > num_of_threads)
+  {
+    num_of_nodes = num_of_threads;
+  }
+  ChainReplica *replicas = calloc (num_of_nodes, sizeof (ChainReplica));
+  GenerateTask *tasks = calloc (num_of_threads, sizeof (GenerateTask));
+  void **replica_args = malloc (num_of_threads * sizeof (void *));
+  void **task_args = malloc (num_of_threads * sizeof (void *));
+  bool success = (replicas != NULL) & (tasks != NULL)
+                 & (replica_args != NULL) & (task_args != NULL);
+  for (int i = 0; success && (i < num_of_nodes); i++)
+  {
+    success = create_chain_replica (markov_chain, nodes[i], false, bounded,
+                                    &replicas[i]);
+  }
+  for (int i = 0; success && (i < num_of_threads); i++)
+  {
+    tasks[i].replica = &replicas[i % num_of_nodes];
+    tasks[i].seed = seed;
+    tasks[i].bounded = bounded;
+    replica_args[i] = tasks[i].replica;
+    task_args[i] = &tasks[i];
+  }
+  WorkerPool *pool = success ? create_worker_pool (num_of_threads,
+                                                   bind_to_replica_node,
+                                                   replica_args)
+                             : NULL;
+  success = (pool != NULL);
+  trace_end ();
+  for (long int round = 0; success && (round < tweet_to_create);
+       round += (long int) num_of_threads * TWEETS_PER_ROUND)
+  {
+    long int round_len = tweet_to_create - round;
+    if (round_len > (long int) num_of_threads * TWEETS_PER_ROUND)
+    {
+      round_len = (long int) num_of_threads * TWEETS_PER_ROUND;
+    }
+    for (int i = 0; i < num_of_threads; i++)
+    {
+      tasks[i].first_tweet = round + round_len * i / num_of_threads;
+      tasks[i].last_tweet = round + round_len * (i + 1) / num_of_threads;
+    }
+    run_worker_pool (pool, generate_tweets, task_args);
+    for (int i = 0; success && (i < num_of_threads); i++)
+    {
+      success = !tasks[i].failed;
+      if (success)
+      {
+        fwrite (tasks[i].text, 1, tasks[i].text_len, stdout);
+      }
+    }
+  }
+  if (!success)
+  {
+    printf ("%s", ALLOCATION_ERROR_MASSAGE);
+  }
+  free_worker_pool (&pool);
+  for (int i = 0; (tasks != NULL) && (i < num_of_threads); i++)
+  {
+    free (tasks[i].text);
+  }
+  for (int i = 0; (replicas != NULL) && (i < num_of_nodes); i++)
+  {
+    free_chain_replica (&replicas[i]);
+  }
+  free (replicas);
+  free (tasks);
+  free (replica_args);
+  free (task_args);
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * This function measures the time since an unspecified start.
+ * @return time in microseconds.
+ */
+static double get_time_us (void)
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec * MICROS_IN_SECOND + now.tv_nsec * MICROS_IN_NANO;
+}
+
+/**
+ * This function generates tweets from the latest published snapshot, one
+ * at a time, until training is done, and measures how long each one takes.
+ * It runs as a reader thread, and never waits for the writer.
+ * @param arg pointer to the LiveReader.
+ * @return NULL.
+ */
+static void *read_live_chain (void *arg)
+{
+  LiveReader *reader = arg;
+  MarkovNode *sequence[MAX_WORDS_IN_TWEET];
+  char *text = NULL;
+  size_t text_len, text_capacity = 0;
+  while (__atomic_load_n (reader->training, __ATOMIC_ACQUIRE))
+  {
+    double start = get_time_us ();
+    const ChainSnapshot *snapshot = enter_snapshot (reader->publisher,
+                                                    reader->id);
+    if (snapshot != NULL)
+    {
+      MarkovNode *first_node = choose_replica_first_node (&snapshot->replica,
+                                                          &reader->seed);
+      int length = (first_node == NULL) ? 0
+          : generate_random_sequence_to_array_r (
+              snapshot->replica.markov_chain, first_node, MAX_WORDS_IN_TWEET,
+              sequence, &reader->seed);
+      text_len = 0;
+      reader->failed = !append_tweet (&text, &text_len, &text_capacity,
+                                      reader->num_of_tweets + 1, sequence,
+                                      length);
+    }
+    leave_snapshot (reader->publisher, reader->id);
+    if (reader->failed)
+    {
+      break;
+    }
+    if (snapshot == NULL)
+    {
+      sched_yield (); // nothing was published yet
+      continue;
+    }
+    double latency = get_time_us () - start;
+    reader->num_of_tweets++;
+    reader->total_latency_us += latency;
+    if (latency > reader->max_latency_us)
+    {
+      reader->max_latency_us = latency;
+    }
+  }
+  free (text);
+  return NULL;
+}
+
+/**
+ * This function fills a markov chain as fill_database does, while reader
+ * threads generate tweets from it. Every live_interval words, the writer
+ * publishes a snapshot of the chain, which the readers sample from without
+ * locks. Snapshots are freed once no reader holds them. The num of
+ * snapshots and of tweets, and the latency of the readers, are printed once
+ * training is done.
+ * @param fp a pinter to the file that includes all the words.
+ * @param words_to_read as in fill_database.
+ * @param markov_chain a pointer to the markov chain.
+ * @param options the modes to train the chain with.
+ * @param line_dedup filter of repeated lines, or NULL.
+ * @param seed
+ * @return EXIT_FAILURE in case of memory allocation failure, EXIT_SUCCESS
+ * otherwise.
+ */
+static int fill_database_live (FILE *fp, long int words_to_read,
+                               MarkovChain *markov_chain,
+                               const GeneratorOptions *options,
+                               LineDedup *line_dedup, unsigned int seed)
+{
+  int num_of_readers = options->live_readers;
+  SnapshotPublisher *publisher = create_snapshot_publisher (num_of_readers);
+  pthread_t *threads = malloc (num_of_readers * sizeof (pthread_t));
+  LiveReader *readers = calloc (num_of_readers, sizeof (LiveReader));
+  if ((publisher == NULL) | (threads == NULL) | (readers == NULL))
+  {
+    printf ("%s", ALLOCATION_ERROR_MASSAGE);
+    free_snapshot_publisher (&publisher);
+    free (threads);
+    free (readers);
+    return EXIT_FAILURE;
+  }
+  bool training = true;
+  int started = 0;
+  for (int i = 0; i < num_of_readers; i++)
+  {
+    readers[i] = (LiveReader) {publisher, i,
+                               seed + (unsigned int) i * TWEET_SEED_STEP,
+                               &training, 0, 0, 0, false};
+    if (pthread_create (&threads[i], NULL, read_live_chain, &readers[i]) != 0)
+    {
+      break;
+    }
+    started++;
+  }
+  int status = fill_database (fp, words_to_read, markov_chain, options,
+                              line_dedup, publisher);
+  __atomic_store_n (&training, false, __ATOMIC_RELEASE);
+  long int num_of_tweets = 0;
+  double total_latency_us = 0, max_latency_us = 0;
+  for (int i = 0; i < started; i++)
+  {
+    pthread_join (threads[i], NULL);
+    num_of_tweets += readers[i].num_of_tweets;
+    total_latency_us += readers[i].total_latency_us;
+    if (readers[i].max_latency_us > max_latency_us)
+    {
+      max_latency_us = readers[i].max_latency_us;
+    }
+    if (readers[i].failed && (status == EXIT_SUCCESS))
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      status = EXIT_FAILURE;
+    }
+  }
+  printf (LIVE_FORMAT, PRINT_LIVE, publisher->num_of_published,
+          publisher->num_of_freed, num_of_tweets, started,
+          (num_of_tweets == 0) ? 0 : total_latency_us / num_of_tweets,
+          max_latency_us);
+  trace_counter (SNAPSHOTS_COUNTER, publisher->num_of_published);
+  trace_counter (LIVE_TWEETS_COUNTER, num_of_tweets);
+  free_snapshot_publisher (&publisher);
+  free (threads);
+  free (readers);
+  return status;
+}
+
+/**
+ * This function records the num of duplicate lines skipped, if tracing.
+ * @param line_dedup filter of repeated lines, or NULL.
+ */
+static void trace_dedup (const LineDedup *line_dedup)
+{
+  if (line_dedup != NULL)
+  {
+    trace_counter (DUPLICATES_COUNTER, line_dedup->num_of_duplicates);
+  }
+}
+
+/**
+ * This function runs the modes that use a trained chain: it compresses the
+ * chain, scores the score file against it and generates the tweets, as the
+ * options ask.
+ * @param markov_chain the trained chain.
+ * @param options
+ * @param seed
+ * @param num_of_tweets num of tweets to generate.
+ * @return EXIT_FAILURE in case of invalid file or memory allocation failure,
+ * EXIT_SUCCESS otherwise.
+ */
+static int use_markov_chain (MarkovChain *markov_chain,
+                             const GeneratorOptions *options, long int seed,
+                             long int num_of_tweets)
+{
+  int status = EXIT_SUCCESS;
+  BoundedGenerator *generator = NULL;
+  if (options->compress)
+  {
+    trace_begin (COMPRESS_PHASE);
+    status = compress_markov_chain (markov_chain) ? EXIT_SUCCESS
+                                                  : EXIT_FAILURE;
+    trace_end ();
+  }
+  // with --numa, each replica builds its own generator, on its node
+  if ((status == EXIT_SUCCESS) && options->bounded && !options->numa)
+  {
+    trace_begin (DISTANCES_PHASE);
+    generator = create_bounded_generator (markov_chain);
+    status = (generator != NULL) ? EXIT_SUCCESS : EXIT_FAILURE;
+    trace_end ();
+  }
+  if ((status == EXIT_SUCCESS) && (options->score_path != NULL))
+  {
+    trace_begin (SCORE_PHASE);
+    status = score_file (markov_chain, options->score_path,
+                         options->num_of_threads);
+    trace_end ();
+  }
+  if ((status == EXIT_SUCCESS) && options->numa)
+  {
+    trace_begin (GENERATE_PHASE);
+    status = generate_sequences_numa (markov_chain, num_of_tweets,
+                                      (unsigned int) seed,
+                                      options->num_of_threads,
+                                      options->bounded);
+    trace_end ();
+  }
+  else if ((status == EXIT_SUCCESS) && (options->unique_retries > 0))
+  {
+    trace_begin (GENERATE_PHASE);
+    srand (seed);
+    status = generate_unique_sequences (markov_chain, num_of_tweets,
+                                        options->unique_retries, generator);
+    trace_end ();
+  }
+  else if ((status == EXIT_SUCCESS) && options->bounded)
+  {
+    trace_begin (GENERATE_PHASE);
+    srand (seed);
+    generate_bounded_sequences (generator, num_of_tweets);
+    trace_end ();
+  }
+  else if (status == EXIT_SUCCESS)
+  {
+    trace_begin (GENERATE_PHASE);
+    srand (seed);
+    generate_sequences (markov_chain, num_of_tweets);
+    trace_end ();
+  }
+  free_bounded_generator (&generator);
+  return status;
+}
+
+/**
+ * This function trains a model per hashtag or per input file in a single
+ * pass over the input files, and uses each model as use_markov_chain does,
+ * after printing its name. The models share the word pool.
+ * @param path the first input file.
+ * @param words_to_read If the number of words to be read is limited then the
+ * number of the words itself, and if not then 0.
+ * @param options
+ * @param seed
+ * @param num_of_tweets num of tweets to generate from each model.
+ * @param line_dedup filter of repeated lines, as in fill_database, or NULL.
+ * @return EXIT_FAILURE in case of invalid file or memory allocation failure,
+ * EXIT_SUCCESS otherwise.
+ */
+static int run_split_training (const char *path, long int words_to_read,
+                               GeneratorOptions *options, long int seed,
+                               long int num_of_tweets, LineDedup *line_dedup)
+{
+  const char *paths[MAX_INPUTS + 1] = {path};
+  for (int i = 0; i < options->num_of_inputs; i++)
+  {
+    paths[i + 1] = options->input_paths[i];
+  }
+  ModelSet model_set = {NULL, 0, 0, NULL, 0, false, create_string_pool ()};
+  int status = EXIT_SUCCESS;
+  if (model_set.word_pool == NULL)
+  {
+    printf ("%s", ALLOCATION_ERROR_MASSAGE);
+    status = EXIT_FAILURE;
+  }
+  else if (options->model_names != NULL)
+  {
+    status = create_listed_models (&model_set, options->model_names,
+                                   options->split);
+  }
+  if (status == EXIT_SUCCESS)
+  {
+    trace_begin (FILL_DATABASE_PHASE);
+    status = fill_models (paths, options->num_of_inputs + 1, words_to_read,
+                          &model_set, options, line_dedup);
+    trace_end ();
+    trace_dedup (line_dedup);
+  }
+  for (int i = 0; (status == EXIT_SUCCESS) && (i < model_set.num_of_models);
+       i++)
+  {
+    printf ("%s %s:%s", PRINT_MODEL, model_set.models[i].name, LINE_BREAK);
+    // the words of a score file are not interned
+    model_set.models[i].markov_chain->comp_func = s_comp_func;
+    status = use_markov_chain (model_set.models[i].markov_chain, options,
+                               seed, num_of_tweets);
+  }
+  trace_begin (FREE_PHASE);
+  free_model_set (&model_set);
+  free_string_pool (&model_set.word_pool);
+  trace_end ();
+  return status;
+}
+
+int main (int argc, char *argv[])
+{
+  GeneratorOptions options = {0, 0, 0, NULL,
+                              (int) sysconf (_SC_NPROCESSORS_ONLN), NULL,
+                              false, false, false, NO_SPLIT, {NULL}, 0, NULL,
+                              NO_DEDUP, DEFAULT_DEDUP_KB, 0, false, 0, 0};
+  argc = parse_options (argc, argv, &options);
+  if ((argc == -1) || !check_args_validity (argc, argv))
+  {
+    return EXIT_FAILURE;
+  }
+  if ((options.split == NO_SPLIT)
+      && ((options.num_of_inputs > 0) || (options.model_names != NULL)))
+  {
+    printf ("%s", INPUT_ERROR);
+    return EXIT_FAILURE;
+  }
+  if ((options.split != NO_SPLIT) && (options.live_readers > 0))
+  {
+    printf ("%s", LIVE_ERROR);
+    return EXIT_FAILURE;
+  }
+  if (options.numa && (options.unique_retries > 0))
+  {
+    printf ("%s", UNIQUE_ERROR);
+    return EXIT_FAILURE;
+  }
+  if (options.num_of_threads < 1)
+  {
+    options.num_of_threads = 1;
+  }
+  if ((options.trace_path != NULL) && !trace_start (options.trace_path))
+  {
+    printf ("%s", TRACE_ERROR);
+    return EXIT_FAILURE;
+  }
+  long int seed = convert_char_to_int (argv[1]);
+  long int num_of_tweets = convert_char_to_int (argv[2]);
+  const char *path = argv[3];
+  long int words_to_read = 0;
+  if (argc == FIVE_ARGC)
+  {
+    words_to_read = convert_char_to_int (argv[4]);
+  }
+  LineDedup *line_dedup = NULL;
+  if (options.dedup != NO_DEDUP)
+  {
+    line_dedup = create_line_dedup (options.dedup == DEDUP_NEAR,
+                                    (size_t) options.dedup_kb * BYTES_IN_KB);
+    if (line_dedup == NULL)
+    {
+      printf ("%s", ALLOCATION_ERROR_MASSAGE);
+      trace_finish ();
+      return EXIT_FAILURE;
+    }
+  }
+  if (options.split != NO_SPLIT)
+  {
+    int status = run_split_training (path, words_to_read, &options, seed,
+                                     num_of_tweets, line_dedup);
+    free_line_dedup (&line_dedup);
+    if (!trace_finish ())
+    {
+      printf ("%s", TRACE_ERROR);
+      return EXIT_FAILURE;
+    }
+    return status;
+  }
+  trace_begin (OPEN_FILE_PHASE);
+  InputStream *in_stream = open_input_stream (path);
+  trace_end ();
+  if (in_stream == NULL)
+  {
+    printf ("%s", PATH_ERROR);
+    free_line_dedup (&line_dedup);
+    trace_finish ();
+    return EXIT_FAILURE;
+  }
+  MarkovChain *markov_chain = create_markov_chain ();
+  if (markov_chain == NULL)
+  {
+    printf ("%s", ALLOCATION_ERROR_MASSAGE);
+    free_line_dedup (&line_dedup);
+    close_input_stream (&in_stream);
+    trace_finish ();
+    return EXIT_FAILURE;
+  }
+  trace_begin (FILL_DATABASE_PHASE);
+  int status = (options.live_readers > 0)
+      ? fill_database_live (in_stream->fp, words_to_read, markov_chain,
+                            &options, line_dedup, (unsigned int) seed)
+      : fill_database (in_stream->fp, words_to_read, markov_chain, &options,
+                       line_dedup, NULL);
+  if (!close_input_stream (&in_stream) && (status == EXIT_SUCCESS))
+  {
+    printf ("%s", DECOMPRESS_ERROR);
+    status = EXIT_FAILURE;
+  }
+  trace_end ();
+  trace_dedup (line_dedup);
+  free_line_dedup (&line_dedup);
+  if (status == EXIT_SUCCESS)
+  {
+    status = use_markov_chain (markov_chain, &options, seed, num_of_tweets);
+  }
+  trace_begin (FREE_PHASE);
+  free_markov_chain (&markov_chain);
+  trace_end ();
+  if (!trace_finish ())
+  {
+    printf ("%s", TRACE_ERROR);
+    return EXIT_FAILURE;
+  }
+  return status;
+}
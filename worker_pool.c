@@ -0,0 +1,150 @@
+#include "worker_pool.h"
+#include <stdlib.h>
+#include <pthread.h>
+
+/**
+ * struct holds what a single worker thread needs to find its work
+ */
+typedef struct WorkerSlot {
+    WorkerPool *pool;
+    int index;
+    void *init_arg;
+} WorkerSlot;
+
+struct WorkerPool {
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready; // a round started, or the pool is closing
+    pthread_cond_t work_done; // the last busy worker finished its round
+    pthread_t *threads;
+    WorkerSlot *slots;
+    int num_of_workers;
+    int num_of_started; // the workers 0 to num_of_started - 1 run on threads
+    work_f init;
+    work_f work;
+    void **args;
+    long int round; // num of rounds started
+    int num_of_busy; // num of workers still in the current round
+    bool closing;
+};
+
+/**
+ * This function runs a worker thread: it waits for each round, runs its work
+ * and reports it's done, until the pool closes.
+ * @param arg pointer to the WorkerSlot of the worker.
+ * @return NULL.
+ */
+static void *run_worker (void *arg)
+{
+  WorkerSlot *slot = arg;
+  WorkerPool *pool = slot->pool;
+  if (pool->init != NULL)
+  {
+    pool->init (slot->init_arg);
+  }
+  long int done_round = 0;
+  pthread_mutex_lock (&pool->lock);
+  while (true)
+  {
+    while ((pool->round == done_round) && !pool->closing)
+    {
+      pthread_cond_wait (&pool->work_ready, &pool->lock);
+    }
+    if (pool->round == done_round)
+    {
+      break;
+    }
+    done_round = pool->round;
+    work_f work = pool->work;
+    void *work_arg = pool->args[slot->index];
+    pthread_mutex_unlock (&pool->lock);
+    work (work_arg);
+    pthread_mutex_lock (&pool->lock);
+    pool->num_of_busy--;
+    if (pool->num_of_busy == 0)
+    {
+      pthread_cond_signal (&pool->work_done);
+    }
+  }
+  pthread_mutex_unlock (&pool->lock);
+  return NULL;
+}
+
+WorkerPool *create_worker_pool (int num_of_workers, work_f init,
+                                void **init_args)
+{
+  WorkerPool *pool = malloc (sizeof (WorkerPool));
+  if (pool == NULL)
+  {
+    return NULL;
+  }
+  *pool = (WorkerPool) {.num_of_workers = num_of_workers, .init = init};
+  pool->threads = malloc (num_of_workers * sizeof (pthread_t));
+  pool->slots = malloc (num_of_workers * sizeof (WorkerSlot));
+  if ((pool->threads == NULL) | (pool->slots == NULL))
+  {
+    free (pool->threads);
+    free (pool->slots);
+    free (pool);
+    return NULL;
+  }
+  pthread_mutex_init (&pool->lock, NULL);
+  pthread_cond_init (&pool->work_ready, NULL);
+  pthread_cond_init (&pool->work_done, NULL);
+  for (int i = 0; i < num_of_workers; i++)
+  {
+    pool->slots[i] = (WorkerSlot) {pool, i,
+                                   (init_args == NULL) ? NULL : init_args[i]};
+    if (pthread_create (&pool->threads[i], NULL, run_worker, &pool->slots[i])
+        != 0)
+    {
+      break;
+    }
+    pool->num_of_started++;
+  }
+  return pool;
+}
+
+void run_worker_pool (WorkerPool *pool, work_f work, void **args)
+{
+  pthread_mutex_lock (&pool->lock);
+  pool->work = work;
+  pool->args = args;
+  pool->num_of_busy = pool->num_of_started;
+  pool->round++;
+  pthread_cond_broadcast (&pool->work_ready);
+  pthread_mutex_unlock (&pool->lock);
+  for (int i = pool->num_of_started; i < pool->num_of_workers; i++)
+  {
+    work (args[i]);
+  }
+  pthread_mutex_lock (&pool->lock);
+  while (pool->num_of_busy > 0)
+  {
+    pthread_cond_wait (&pool->work_done, &pool->lock);
+  }
+  pthread_mutex_unlock (&pool->lock);
+}
+
+void free_worker_pool (WorkerPool **ptr_pool)
+{
+  WorkerPool *pool = *ptr_pool;
+  if (pool == NULL)
+  {
+    return;
+  }
+  pthread_mutex_lock (&pool->lock);
+  pool->closing = true;
+  pthread_cond_broadcast (&pool->work_ready);
+  pthread_mutex_unlock (&pool->lock);
+  for (int i = 0; i < pool->num_of_started; i++)
+  {
+    pthread_join (pool->threads[i], NULL);
+  }
+  pthread_mutex_destroy (&pool->lock);
+  pthread_cond_destroy (&pool->work_ready);
+  pthread_cond_destroy (&pool->work_done);
+  free (pool->threads);
+  free (pool->slots);
+  free (pool);
+  *ptr_pool = NULL;
+}
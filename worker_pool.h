@@ -0,0 +1,45 @@
+#ifndef _WORKER_POOL_H_
+#define _WORKER_POOL_H_
+#include <stdbool.h>
+
+/**
+ * A thread function, as taken by pthread_create
+ */
+typedef void *(*work_f)(void *arg);
+
+/**
+ * A fixed set of threads that run one round of work after another, so a
+ * caller that splits many batches between threads starts them only once.
+ */
+typedef struct WorkerPool WorkerPool;
+
+/**
+ * Start the threads of a pool. Each thread first runs init on its own
+ * argument, e.g. to pin itself, and then waits for rounds of work. Threads
+ * that fail to start are left out, and their work is run by the caller of
+ * run_worker_pool.
+ * @param num_of_workers num of threads to start
+ * @param init function to run once on each thread, or NULL
+ * @param init_args argument of init for each thread, or NULL
+ * @return pointer to WorkerPool, NULL in case of allocation failure.
+ */
+WorkerPool *create_worker_pool(int num_of_workers, work_f init,
+                               void **init_args);
+
+/**
+ * Run a single round of work: worker i runs work (args[i]), and the call
+ * returns when every worker is done. The work of the workers that did not
+ * start is run by the caller, one after the other.
+ * @param pool
+ * @param work function to run on each worker
+ * @param args argument of work for each worker, num_of_workers of them
+ */
+void run_worker_pool(WorkerPool *pool, work_f work, void **args);
+
+/**
+ * Stop the threads of a pool and free it. The pool must be idle.
+ * @param ptr_pool pointer to the pool, set to NULL
+ */
+void free_worker_pool(WorkerPool **ptr_pool);
+
+#endif //_WORKER_POOL_H_